@@ -0,0 +1,81 @@
+#pragma once
+
+// Helpers shared by the benchmarks. Each benchmark is a single translation
+// unit, so this header also replaces the global allocation functions to
+// count heap allocations.
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+
+namespace bench {
+
+struct AllocationStats {
+    std::atomic<unsigned long long> count;
+    std::atomic<unsigned long long> bytes;
+};
+
+inline AllocationStats& allocationStats() {
+    static AllocationStats stats;
+    return stats;
+}
+
+inline unsigned long long allocationCount() {
+    return allocationStats().count.load();
+}
+
+inline unsigned long long allocatedBytes() {
+    return allocationStats().bytes.load();
+}
+
+// Restarts the peak resident set size from the current one, so that each
+// measurement gets its own peak. Returns false if the system can't.
+inline bool resetPeakResidentSetSize() {
+#ifdef __linux__
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5" << std::endl;
+    return bool(clearRefs);
+#else
+    return false;
+#endif
+}
+
+class Timer {
+public:
+    Timer(): m_Start(std::chrono::steady_clock::now()) {
+    }
+
+    // Return the elapsed time in seconds
+    double elapsed() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_Start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_Start;
+};
+
+}
+
+// Not inlined: once the compiler sees malloc behind new and free behind
+// delete at a call site, it reports them as mismatched
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+BENCH_NOINLINE void* operator new(std::size_t size) {
+    bench::allocationStats().count++;
+    bench::allocationStats().bytes += size;
+    if(void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+BENCH_NOINLINE void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
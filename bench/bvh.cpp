@@ -0,0 +1,52 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "glimac/BVH.hpp"
+#include "glimac/Parallel.hpp"
+#include "bench.hpp"
+#include "scene.hpp"
+
+// BVH build benchmark: builds the BVH of synthetic scenes of increasing size
+// and reports the build time and the SAH cost per million triangles. One
+// JSON object per line on stdout, the logs go to stderr.
+//
+// usage: bench_bvh [directory [triangles...]]
+// The default sizes are 100K, 1M and 4M triangles.
+
+int main(int argc, char** argv) {
+    std::string directory = argc > 1 ? argv[1] : ".";
+    std::vector<size_t> sizes;
+    for(int i = 2; i < argc; ++i) {
+        sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+    }
+    if(sizes.empty()) {
+        sizes = { 100000, 1000000, 4000000 };
+    }
+
+    for(auto size: sizes) {
+        auto objPath = directory + "/bench_bvh_" + std::to_string(size) + ".obj";
+        glimac::Geometry geometry;
+        if(!bench::loadSyntheticScene(geometry, objPath, size, bench::FaceFormat::Normals,
+                                      glimac::Geometry::OPTIMIZE_VERTEX_CACHE)) {
+            return EXIT_FAILURE;
+        }
+
+        // Best of a few builds
+        glimac::BVH bvh;
+        double seconds = 1e30;
+        for(int run = 0; run < 3; ++run) {
+            bench::Timer timer;
+            bvh.build(geometry);
+            seconds = std::min(seconds, timer.elapsed());
+        }
+        double millions = geometry.getIndexCount() / 3 / 1e6;
+        printf("{\"triangles\": %zu, \"threads\": %u, \"nodes\": %zu, \"seconds\": %.6f, "
+               "\"seconds_per_million\": %.6f, \"sah_cost\": %.3f}\n",
+               geometry.getIndexCount() / 3, glimac::getThreadCount(), bvh.getNodeCount(), seconds,
+               seconds / millions, bvh.getSAHCost());
+        fflush(stdout);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "tiny_obj_loader.h"
+#include "glimac/Geometry.hpp"
+#include "bench.hpp"
+#include "scene.hpp"
+
+// OBJ loading benchmark: writes synthetic scenes for each face format and
+// size, then times tinyobj::LoadObj, Geometry::loadOBJ from the OBJ and
+// Geometry::loadOBJ from its binary cache. One JSON object per line on
+// stdout, the loaders' logs go to stderr.
+//
+// usage: bench_loadobj [directory [triangles...]]
+// The default sizes are 1K, 100K and 1M triangles; 50M takes about 6 GB of
+// disk for the three formats.
+
+// Only the parse and the cache are measured: no textures, no processing pass
+static const unsigned int LOAD_OPTIONS = 0;
+
+struct Measure {
+    double seconds;
+    size_t peakBytes;
+    unsigned long long allocations;
+    unsigned long long allocatedBytes;
+};
+
+template<typename Fn>
+static Measure measure(Fn fn) {
+    bool peakReset = bench::resetPeakResidentSetSize();
+    auto allocations = bench::allocationCount();
+    auto allocatedBytes = bench::allocatedBytes();
+    bench::Timer timer;
+    fn();
+    Measure m;
+    m.seconds = timer.elapsed();
+    m.peakBytes = peakReset ? glimac::peakResidentSetSize() : 0;
+    m.allocations = bench::allocationCount() - allocations;
+    m.allocatedBytes = bench::allocatedBytes() - allocatedBytes;
+    return m;
+}
+
+static void report(const char* loader, bench::FaceFormat format, size_t triangles, size_t fileBytes,
+                   const Measure& m, bool ok) {
+    double megaBytes = fileBytes / (1024. * 1024.);
+    printf("{\"loader\": \"%s\", \"format\": \"%s\", \"triangles\": %zu, \"file_mb\": %.3f, \"ok\": %s, "
+           "\"seconds\": %.6f, \"mb_per_s\": %.2f, \"triangles_per_s\": %.0f, \"peak_rss_mb\": %.2f, "
+           "\"allocations\": %llu, \"allocated_mb\": %.2f}\n",
+           loader, bench::faceFormatName(format), triangles, megaBytes, ok ? "true" : "false",
+           m.seconds, megaBytes / m.seconds, triangles / m.seconds, m.peakBytes / (1024. * 1024.),
+           m.allocations, m.allocatedBytes / (1024. * 1024.));
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    std::string directory = argc > 1 ? argv[1] : ".";
+    std::vector<size_t> sizes;
+    for(int i = 2; i < argc; ++i) {
+        sizes.push_back(std::strtoull(argv[i], nullptr, 10));
+    }
+    if(sizes.empty()) {
+        sizes = { 1000, 100000, 1000000 };
+    }
+
+    const bench::FaceFormat formats[] = {
+        bench::FaceFormat::Normals, bench::FaceFormat::TexCoordsNormals, bench::FaceFormat::Negative
+    };
+
+    bool success = true;
+    for(auto size: sizes) {
+        for(auto format: formats) {
+            auto objPath = directory + "/bench_" + std::to_string(size) + "_" + std::to_string(int(format)) + ".obj";
+            auto triangles = bench::writeScene(objPath, size, format);
+            struct stat st;
+            if(!triangles || stat(objPath.c_str(), &st) != 0) {
+                fprintf(stderr, "cannot write %s\n", objPath.c_str());
+                return EXIT_FAILURE;
+            }
+            auto cachePath = objPath + ".gmesh";
+            std::remove(cachePath.c_str());
+
+            bool ok = false;
+            auto m = measure([&]() {
+                std::vector<tinyobj::shape_t> shapes;
+                std::vector<tinyobj::material_t> materials;
+                ok = tinyobj::LoadObj(shapes, materials, objPath.c_str(), (directory + "/").c_str()).empty();
+            });
+            report("tinyobj::LoadObj", format, triangles, st.st_size, m, ok);
+            success = success && ok;
+
+            m = measure([&]() {
+                glimac::Geometry geometry;
+                ok = geometry.loadOBJ(objPath, directory, LOAD_OPTIONS);
+            });
+            report("Geometry::loadOBJ", format, triangles, st.st_size, m, ok);
+            success = success && ok;
+
+            m = measure([&]() {
+                glimac::Geometry geometry;
+                ok = geometry.loadOBJ(objPath, directory, LOAD_OPTIONS);
+            });
+            report("Geometry::loadOBJ cached", format, triangles, st.st_size, m, ok);
+            success = success && ok;
+
+            std::remove(cachePath.c_str());
+            std::remove(objPath.c_str());
+            std::remove((objPath + ".mtl").c_str());
+        }
+    }
+
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
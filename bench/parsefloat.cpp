@@ -0,0 +1,78 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "tiny_obj_loader.h"
+#include "bench.hpp"
+
+// Float scanning microbenchmark: the loader's former strspn/atof/strcspn
+// path against tinyobj::ScanFloat, over OBJ-like "v x y z" lines.
+
+static double legacyParse(const char* token, const char* end, float* out, size_t& count) {
+    bench::Timer timer;
+    count = 0;
+    while(token < end) {
+        token += strspn(token, " \t\nv");
+        if(token >= end) {
+            break;
+        }
+        out[count++] = (float) atof(token);
+        token += strcspn(token, " \t\r\n");
+    }
+    return timer.elapsed();
+}
+
+static double scanParse(const char* token, const char* end, float* out, size_t& count) {
+    bench::Timer timer;
+    count = 0;
+    while(token < end) {
+        token += strspn(token, " \t\nv");
+        if(token >= end) {
+            break;
+        }
+        token = tinyobj::ScanFloat(token, end, out[count++]);
+    }
+    return timer.elapsed();
+}
+
+int main(int argc, char** argv) {
+    size_t lineCount = argc > 1 ? atol(argv[1]) : 2000000;
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> coordinate(-1000., 1000.);
+    std::string text;
+    char line[128];
+    for(size_t i = 0; i < lineCount; ++i) {
+        snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", coordinate(rng), coordinate(rng), coordinate(rng));
+        text += line;
+    }
+
+    const char* begin = text.c_str();
+    const char* end = begin + text.size();
+    std::vector<float> legacy(3 * lineCount), scanned(3 * lineCount);
+
+    double legacyTime = 1e30, scanTime = 1e30;
+    size_t legacyCount = 0, scanCount = 0;
+    for(int run = 0; run < 3; ++run) {
+        legacyTime = std::min(legacyTime, legacyParse(begin, end, legacy.data(), legacyCount));
+        scanTime = std::min(scanTime, scanParse(begin, end, scanned.data(), scanCount));
+    }
+
+    // The legacy path rounds twice (to double, then to float): count where
+    // the correctly rounded result differs.
+    size_t differences = 0;
+    for(size_t i = 0; i < std::min(legacyCount, scanCount); ++i) {
+        differences += memcmp(&legacy[i], &scanned[i], sizeof(float)) != 0;
+    }
+
+    double megaBytes = text.size() / (1024. * 1024.);
+    printf("floats %zu size %.1f MB\n", scanCount, megaBytes);
+    printf("atof     %.3f s %.1f MB/s %.1f ns/float\n", legacyTime, megaBytes / legacyTime, 1e9 * legacyTime / legacyCount);
+    printf("ScanFloat %.3f s %.1f MB/s %.1f ns/float\n", scanTime, megaBytes / scanTime, 1e9 * scanTime / scanCount);
+    printf("differences %zu\n", differences);
+
+    return legacyCount == scanCount ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,56 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <string>
+#include "glimac/Geometry.hpp"
+#include "bench.hpp"
+#include "scene.hpp"
+
+// Position stream benchmark: a position-only CPU pass over all the vertices,
+// as done by culling or by a software depth pass, reading the interleaved
+// vertex buffer and then the position buffer of Geometry::buildPositionBuffer.
+//
+// usage: bench_positions [file.obj]
+// Without a file, a synthetic scene of 4M triangles is written and used.
+
+// Best of a few runs of a pass that projects the positions and keeps the
+// bounds of their depth, reading them 'stride' bytes apart
+static double positionPass(const glm::vec3* pPositions, size_t count, size_t stride, float& checksum) {
+    auto viewProj = glm::perspective(1.f, 1.f, .1f, 1000.f) *
+                    glm::lookAt(glm::vec3(-10.f, 20.f, -10.f), glm::vec3(50.f, 0.f, 50.f), glm::vec3(0.f, 1.f, 0.f));
+    double seconds = 1e30;
+    for(int run = 0; run < 5; ++run) {
+        float minDepth = 1e30f, maxDepth = -1e30f;
+        bench::Timer timer;
+        auto pPosition = (const char*) pPositions;
+        for(size_t i = 0; i < count; ++i, pPosition += stride) {
+            auto clip = viewProj * glm::vec4(*(const glm::vec3*) pPosition, 1.f);
+            float depth = clip.z / clip.w;
+            minDepth = std::min(minDepth, depth);
+            maxDepth = std::max(maxDepth, depth);
+        }
+        seconds = std::min(seconds, timer.elapsed());
+        checksum = minDepth + maxDepth;
+    }
+    return seconds;
+}
+
+int main(int argc, char** argv) {
+    glimac::Geometry geometry;
+    if(!bench::loadScene(geometry, argc, argv, "bench_positions.obj", 4000000, bench::FaceFormat::TexCoordsNormals,
+                         glimac::Geometry::BUILD_POSITION_BUFFER)) {
+        return EXIT_FAILURE;
+    }
+
+    float checksumInterleaved, checksumPositions;
+    auto count = geometry.getVertexCount();
+    auto secondsInterleaved = positionPass(&geometry.getVertexBuffer()->m_Position, count,
+                                           sizeof(glimac::Geometry::Vertex), checksumInterleaved);
+    auto secondsPositions = positionPass(geometry.getPositionBuffer(), count, sizeof(glm::vec3), checksumPositions);
+
+    printf("vertices %zu\n", count);
+    printf("position pass %.3f ms -> %.3f ms (checksum %g / %g)\n",
+           secondsInterleaved * 1e3, secondsPositions * 1e3, checksumInterleaved, checksumPositions);
+
+    return EXIT_SUCCESS;
+}
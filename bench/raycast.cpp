@@ -0,0 +1,124 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "glimac/BVH.hpp"
+#include "bench.hpp"
+#include "scene.hpp"
+
+// Ray query benchmark: closest-hit and any-hit queries on the BVH of a
+// synthetic scene, one ray at a time and by packets of 4 and 8. The primary
+// rays of a camera, traced by tiles of 4x2 pixels, stand for coherent
+// queries; segments between random points of the scene for incoherent ones.
+//
+// usage: bench_raycast [file.obj]
+// Without a file, a synthetic scene of 100K triangles is written and used.
+
+static const int IMAGE_SIZE = 512;
+
+// Primary rays of an IMAGE_SIZE square image of the box, in tiles of 4x2
+// pixels so that each run of 4 or 8 rays is a packet of neighbours
+static std::vector<glimac::BVH::Ray> primaryRays(const glimac::BBox3f& box) {
+    auto target = center(box);
+    auto diagonal = glm::length(size(box));
+    auto eye = target + glm::vec3(-.6f, .5f, -.6f) * diagonal;
+    auto front = glm::normalize(target - eye);
+    auto left = glm::normalize(glm::cross(glm::vec3(0.f, 1.f, 0.f), front));
+    auto up = glm::cross(front, left);
+    std::vector<glimac::BVH::Ray> rays;
+    rays.reserve(IMAGE_SIZE * IMAGE_SIZE);
+    for(int tileY = 0; tileY < IMAGE_SIZE; tileY += 2) {
+        for(int tileX = 0; tileX < IMAGE_SIZE; tileX += 4) {
+            for(int y = tileY; y < tileY + 2; ++y) {
+                for(int x = tileX; x < tileX + 4; ++x) {
+                    float u = (x + .5f) / IMAGE_SIZE * 2.f - 1.f, v = (y + .5f) / IMAGE_SIZE * 2.f - 1.f;
+                    rays.emplace_back(eye, front - .5f * u * left - .5f * v * up);
+                }
+            }
+        }
+    }
+    return rays;
+}
+
+// Segments between random points of the box
+static std::vector<glimac::BVH::Ray> randomRays(const glimac::BBox3f& box, size_t count) {
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<float> distribution(0.f, 1.f);
+    auto point = [&]() {
+        return box.lower + size(box) * glm::vec3(distribution(generator), distribution(generator), distribution(generator));
+    };
+    std::vector<glimac::BVH::Ray> rays(count);
+    for(auto& ray: rays) {
+        auto origin = point();
+        ray = glimac::BVH::Ray(origin, point() - origin, 0.f, 1.f);
+    }
+    return rays;
+}
+
+// Millions of rays per second, best of a few runs of query over all the rays
+// by packets of packetSize. hitCount is the number of rays that hit.
+template<typename Query>
+static double measure(size_t rayCount, size_t packetSize, const Query& query, size_t& hitCount) {
+    double seconds = 1e30;
+    for(int run = 0; run < 3; ++run) {
+        bench::Timer timer;
+        hitCount = 0;
+        for(size_t i = 0; i < rayCount; i += packetSize) {
+            hitCount += query(i);
+        }
+        seconds = std::min(seconds, timer.elapsed());
+    }
+    return rayCount / seconds * 1e-6;
+}
+
+static void report(const char* name, const glimac::BVH& bvh, const std::vector<glimac::BVH::Ray>& rays) {
+    auto pRays = rays.data();
+    size_t hits1, hits4, hits8, occluded1, occluded4, occluded8;
+    auto closest1 = measure(rays.size(), 1, [&](size_t i) {
+        glimac::BVH::Hit hit;
+        return size_t(bvh.intersect(pRays[i], hit));
+    }, hits1);
+    auto closest4 = measure(rays.size(), 4, [&](size_t i) {
+        glimac::BVH::Hit hits[4];
+        bvh.intersect4(pRays + i, hits);
+        return size_t(std::count_if(hits, hits + 4, [](const glimac::BVH::Hit& hit) { return hit.isHit(); }));
+    }, hits4);
+    auto closest8 = measure(rays.size(), 8, [&](size_t i) {
+        glimac::BVH::Hit hits[8];
+        bvh.intersect8(pRays + i, hits);
+        return size_t(std::count_if(hits, hits + 8, [](const glimac::BVH::Hit& hit) { return hit.isHit(); }));
+    }, hits8);
+    auto any1 = measure(rays.size(), 1, [&](size_t i) {
+        return size_t(bvh.occluded(pRays[i]));
+    }, occluded1);
+    auto any4 = measure(rays.size(), 4, [&](size_t i) {
+        bool occluded[4];
+        bvh.occluded4(pRays + i, occluded);
+        return size_t(std::count(occluded, occluded + 4, true));
+    }, occluded4);
+    auto any8 = measure(rays.size(), 8, [&](size_t i) {
+        bool occluded[8];
+        bvh.occluded8(pRays + i, occluded);
+        return size_t(std::count(occluded, occluded + 8, true));
+    }, occluded8);
+
+    printf("%s rays %zu, hits %zu / %zu / %zu, occluded %zu / %zu / %zu\n", name, rays.size(),
+           hits1, hits4, hits8, occluded1, occluded4, occluded8);
+    printf("  closest hit: %.2f / %.2f / %.2f Mrays/s (1 / 4 / 8 wide)\n", closest1, closest4, closest8);
+    printf("  any hit:     %.2f / %.2f / %.2f Mrays/s (1 / 4 / 8 wide)\n", any1, any4, any8);
+}
+
+int main(int argc, char** argv) {
+    glimac::Geometry geometry;
+    if(!bench::loadScene(geometry, argc, argv, "bench_raycast.obj", 100000, bench::FaceFormat::Normals, 0)) {
+        return EXIT_FAILURE;
+    }
+
+    glimac::BVH bvh(geometry);
+    report("primary", bvh, primaryRays(geometry.getBoundingBox()));
+    report("random", bvh, randomRays(geometry.getBoundingBox(), IMAGE_SIZE * IMAGE_SIZE));
+
+    return EXIT_SUCCESS;
+}
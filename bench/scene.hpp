@@ -0,0 +1,214 @@
+#pragma once
+
+// Synthetic OBJ scenes for the loader benchmarks: spheres and cones laid out
+// on a grid, tessellated with the parametric equations of glimac::Sphere and
+// glimac::Cone but indexed instead of expanded to triangle lists.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "glimac/Geometry.hpp"
+#include "glimac/glm.hpp"
+
+namespace bench {
+
+enum class FaceFormat {
+    Normals,          // f v//vn
+    TexCoordsNormals, // f v/vt/vn
+    Negative          // f v/vt/vn with indices relative to the end of the lists
+};
+
+inline const char* faceFormatName(FaceFormat format) {
+    switch(format) {
+    case FaceFormat::Normals:
+        return "v//vn";
+    case FaceFormat::TexCoordsNormals:
+        return "v/vt/vn";
+    case FaceFormat::Negative:
+        return "v/vt/vn negative";
+    }
+    return "";
+}
+
+class ObjWriter {
+public:
+    ObjWriter(FILE* file, FaceFormat format): m_pFile(file), m_Format(format), m_nVertexCount(0), m_nTriangleCount(0) {
+    }
+
+    size_t getTriangleCount() const {
+        return m_nTriangleCount;
+    }
+
+    void beginObject(const std::string& name, const std::string& material) {
+        fprintf(m_pFile, "o %s\nusemtl %s\n", name.c_str(), material.c_str());
+        m_nObjectBase = m_nVertexCount;
+        m_nObjectVertexCount = 0;
+    }
+
+    void vertex(const glm::vec3& position, const glm::vec3& normal, const glm::vec2& texCoords) {
+        fprintf(m_pFile, "v %.6f %.6f %.6f\n", position.x, position.y, position.z);
+        if(m_Format != FaceFormat::Normals) {
+            fprintf(m_pFile, "vt %.6f %.6f\n", texCoords.x, texCoords.y);
+        }
+        fprintf(m_pFile, "vn %.6f %.6f %.6f\n", normal.x, normal.y, normal.z);
+        ++m_nVertexCount;
+        ++m_nObjectVertexCount;
+    }
+
+    // Indices are relative to the first vertex of the object
+    void triangle(size_t a, size_t b, size_t c) {
+        long long indices[3] = { (long long) a, (long long) b, (long long) c };
+        for(auto& index: indices) {
+            if(m_Format == FaceFormat::Negative) {
+                index -= m_nObjectVertexCount;
+            } else {
+                index += m_nObjectBase + 1;
+            }
+        }
+        if(m_Format == FaceFormat::Normals) {
+            fprintf(m_pFile, "f %lld//%lld %lld//%lld %lld//%lld\n",
+                    indices[0], indices[0], indices[1], indices[1], indices[2], indices[2]);
+        } else {
+            fprintf(m_pFile, "f %lld/%lld/%lld %lld/%lld/%lld %lld/%lld/%lld\n",
+                    indices[0], indices[0], indices[0], indices[1], indices[1], indices[1],
+                    indices[2], indices[2], indices[2]);
+        }
+        ++m_nTriangleCount;
+    }
+
+private:
+    FILE* m_pFile;
+    FaceFormat m_Format;
+    size_t m_nVertexCount;
+    size_t m_nObjectBase;
+    size_t m_nObjectVertexCount;
+    size_t m_nTriangleCount;
+};
+
+// Same vertices and triangles as glimac::Sphere::build
+inline void writeSphere(ObjWriter& writer, const glm::vec3& center, float r, int discLat, int discLong) {
+    float rcpLat = 1.f / discLat, rcpLong = 1.f / discLong;
+    float dPhi = 2 * glm::pi<float>() * rcpLat, dTheta = glm::pi<float>() * rcpLong;
+
+    for(int j = 0; j <= discLong; ++j) {
+        float cosTheta = cos(-glm::pi<float>() / 2 + j * dTheta);
+        float sinTheta = sin(-glm::pi<float>() / 2 + j * dTheta);
+        for(int i = 0; i <= discLat; ++i) {
+            glm::vec3 normal(sin(i * dPhi) * cosTheta, sinTheta, cos(i * dPhi) * cosTheta);
+            writer.vertex(center + r * normal, normal, glm::vec2(i * rcpLat, 1.f - j * rcpLong));
+        }
+    }
+
+    for(int j = 0; j < discLong; ++j) {
+        int offset = j * (discLat + 1);
+        for(int i = 0; i < discLat; ++i) {
+            writer.triangle(offset + i, offset + (i + 1), offset + discLat + 1 + (i + 1));
+            writer.triangle(offset + i, offset + discLat + 1 + (i + 1), offset + i + discLat + 1);
+        }
+    }
+}
+
+// Same vertices and triangles as glimac::Cone::build
+inline void writeCone(ObjWriter& writer, const glm::vec3& center, float height, float r, int discLat, int discHeight) {
+    float rcpLat = 1.f / discLat, rcpH = 1.f / discHeight;
+    float dPhi = 2 * glm::pi<float>() * rcpLat, dH = height * rcpH;
+
+    for(int j = 0; j <= discHeight; ++j) {
+        for(int i = 0; i < discLat; ++i) {
+            glm::vec3 position(r * (height - j * dH) * sin(i * dPhi) / height,
+                               j * dH,
+                               r * (height - j * dH) * cos(i * dPhi) / height);
+            glm::vec3 normal = glm::normalize(glm::vec3(sin(i * dPhi), r / height, cos(i * dPhi)));
+            writer.vertex(center + position, normal, glm::vec2(i * rcpLat, j * rcpH));
+        }
+    }
+
+    for(int j = 0; j < discHeight; ++j) {
+        int offset = j * discLat;
+        for(int i = 0; i < discLat; ++i) {
+            writer.triangle(offset + i, offset + (i + 1) % discLat, offset + discLat + (i + 1) % discLat);
+            writer.triangle(offset + i, offset + discLat + (i + 1) % discLat, offset + i + discLat);
+        }
+    }
+}
+
+// Writes objPath and its material library (objPath + ".mtl") with about
+// 'triangles' triangles, split in objects of at most 32K triangles that
+// alternate between spheres and cones and between a few materials.
+// Returns the number of triangles written, 0 on error.
+inline size_t writeScene(const std::string& objPath, size_t triangles, FaceFormat format) {
+    static const char* materials[] = { "white", "red", "green", "blue", "light" };
+    static const int materialCount = sizeof(materials) / sizeof(materials[0]);
+
+    auto mtlPath = objPath + ".mtl";
+    FILE* mtl = fopen(mtlPath.c_str(), "w");
+    if(!mtl) {
+        return 0;
+    }
+    for(int i = 0; i < materialCount; ++i) {
+        fprintf(mtl, "newmtl %s\nKa 0 0 0\nKd %.2f %.2f %.2f\nKs 0 0 0\nNs 10\nillum 2\n\n",
+                materials[i], (i % 3) * .4f + .2f, (i % 2) * .5f + .2f, .3f);
+    }
+    fclose(mtl);
+
+    FILE* obj = fopen(objPath.c_str(), "w");
+    if(!obj) {
+        return 0;
+    }
+    std::vector<char> buffer(1 << 20);
+    setvbuf(obj, buffer.data(), _IOFBF, buffer.size());
+
+    // Both shapes give 4 * d * d triangles for a discretization d
+    size_t objectTriangles = std::min<size_t>(triangles, 1 << 15);
+    int d = std::max(2, int(std::sqrt(objectTriangles / 4.) + .5));
+    size_t objectCount = std::max<size_t>(1, (triangles + 2 * d * d) / (4 * d * d));
+    size_t side = size_t(std::ceil(std::sqrt(double(objectCount))));
+
+    std::string mtlFile = mtlPath.substr(mtlPath.find_last_of("/\\") + 1);
+    fprintf(obj, "# synthetic scene, %zu objects\nmtllib %s\n", objectCount, mtlFile.c_str());
+
+    ObjWriter writer(obj, format);
+    for(size_t k = 0; k < objectCount; ++k) {
+        glm::vec3 center(3.f * (k % side), 0.f, 3.f * (k / side));
+        writer.beginObject("object" + std::to_string(k), materials[k % materialCount]);
+        if(k % 2 == 0) {
+            writeSphere(writer, center, 1.f, 2 * d, d);
+        } else {
+            writeCone(writer, center, 2.f, 1.f, 2 * d, d);
+        }
+    }
+
+    bool ok = !ferror(obj);
+    fclose(obj);
+    return ok ? writer.getTriangleCount() : 0;
+}
+
+// Writes a scene as writeScene and loads it into geometry with the given
+// load options, then removes the files, the binary cache the load wrote
+// included. Returns false if the scene can't be written or loaded.
+inline bool loadSyntheticScene(glimac::Geometry& geometry, const std::string& objPath, size_t triangles,
+                               FaceFormat format, unsigned int options) {
+    if(!writeScene(objPath, triangles, format)) {
+        fprintf(stderr, "cannot write %s\n", objPath.c_str());
+        return false;
+    }
+    bool ok = geometry.loadOBJ(objPath, glimac::FilePath(objPath).dirPath(), options);
+    std::remove((objPath + ".gmesh").c_str());
+    std::remove((objPath + ".mtl").c_str());
+    std::remove(objPath.c_str());
+    return ok;
+}
+
+// Loads the OBJ file given on the command line, or without one a synthetic
+// scene written to defaultPath, see loadSyntheticScene
+inline bool loadScene(glimac::Geometry& geometry, int argc, char** argv, const std::string& defaultPath,
+                      size_t triangles, FaceFormat format, unsigned int options) {
+    if(argc > 1) {
+        return geometry.loadOBJ(argv[1], glimac::FilePath(argv[1]).dirPath(), options);
+    }
+    return loadSyntheticScene(geometry, defaultPath, triangles, format, options);
+}
+
+}
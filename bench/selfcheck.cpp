@@ -0,0 +1,344 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include "tiny_obj_loader.h"
+#include "glimac/BVH.hpp"
+#include "bench.hpp"
+#include "scene.hpp"
+
+// Self-check of the OBJ loaders, the BVH and the index codec, failing on any
+// mismatch:
+// - LoadObjMapped and LoadObjParallel on 1 to 8 threads give the same shapes
+//   as LoadObj, byte for byte;
+// - every triangle is in exactly one leaf, within the bounds of its nodes;
+// - intersect, intersect4 and intersect8 find the closest hit of a brute
+//   force loop over the triangles, and occluded, occluded4 and occluded8
+//   agree with it;
+// - decodeIndices gives back what encodeIndices was given, and rejects
+//   truncated data.
+//
+// usage: bench_selfcheck [file.obj]
+// Without a file, a synthetic scene of 20K triangles is written and used.
+
+static const size_t RAY_COUNT = 4096;
+static const unsigned int THREAD_COUNTS[] = { 1, 2, 3, 4, 8 };
+
+// OBJ of about 24 MB made of short runs of faces between v/vt/vn, g, o and
+// usemtl lines, so that the chunks of LoadObjParallel end anywhere. Faces
+// mix the formats, quads, and negative indices with absolute ones that reach
+// back to earlier chunks.
+static bool writeChunkTest(const std::string& objPath, const std::string& mtlName) {
+    std::ofstream mtl(objPath.substr(0, objPath.find_last_of('/') + 1) + mtlName);
+    for(int m = 0; m < 4; ++m) {
+        mtl << "newmtl m" << m << "\nKd " << m * .25f << " .5 .5\n";
+    }
+    std::ofstream obj(objPath);
+    obj << "mtllib " << mtlName << "\n";
+    std::mt19937 generator(2);
+    auto random = [&](unsigned int n) {
+        return unsigned(generator() % n);
+    };
+    static const char* formats[] = { "%d/%d/%d", "%d//%d", "%d", "%d/%d" };
+    char corner[64];
+    int vertexCount = 0;
+    for(size_t cell = 0; obj.tellp() < (24 << 20); ++cell) {
+        for(int i = 0; i < 4; ++i) {
+            obj << "v " << cell % 97 + i << " " << i * .125f << " " << random(1000) / 7.f << "\n"
+                << "vt " << random(1000) / 999.f << " " << i * .25f << "\n"
+                << "vn 0 " << i % 2 << " " << 1 - i % 2 << "\n";
+        }
+        vertexCount += 4;
+        if(!random(3)) {
+            obj << "g group" << random(8) << "\n";
+        }
+        if(!random(9)) {
+            obj << "o object" << cell << "\n";
+        }
+        if(random(2)) {
+            obj << "usemtl m" << random(4) << "\n";
+        }
+        auto format = formats[random(4)];
+        for(auto f = random(8); f < 8; ++f) {
+            obj << "f";
+            for(auto k = 0u, count = 3 + random(2); k < count; ++k) {
+                int index = random(3) ? -1 - int(random(4)) : 1 + int(random(vertexCount));
+                snprintf(corner, sizeof(corner), format, index, index, index);
+                obj << " " << corner;
+            }
+            obj << "\n";
+        }
+    }
+    return bool(obj) && bool(mtl);
+}
+
+// Where the chunks of LoadObjParallel start, as it splits the file: after
+// the line break that follows each even split, in at least 1 MB chunks
+static void countChunkStarts(const std::string& data, unsigned int threadCount, size_t& inFaceRuns,
+                             size_t& nextToGroups) {
+    auto chunkCount = std::max<size_t>(1, std::min<size_t>(4 * threadCount, data.size() / (1 << 20)));
+    for(size_t i = 1; i < chunkCount; ++i) {
+        auto start = data.find('\n', data.size() * i / chunkCount);
+        if(start == std::string::npos || start + 1 >= data.size()) {
+            continue;
+        }
+        auto previous = data.rfind('\n', start - 1) + 1;
+        char before = data[previous], after = data[start + 1];
+        inFaceRuns += before == 'f' && after == 'f';
+        nextToGroups += before == 'g' || before == 'u' || before == 'o' || after == 'g' || after == 'u' || after == 'o';
+    }
+}
+
+template<typename T>
+static bool isSameData(const std::vector<T>& a, const std::vector<T>& b) {
+    return a.size() == b.size() && (a.empty() || !std::memcmp(a.data(), b.data(), a.size() * sizeof(T)));
+}
+
+static bool isSameOBJ(const std::vector<tinyobj::shape_t>& shapes, const std::vector<tinyobj::material_t>& materials,
+                      const std::vector<tinyobj::shape_t>& expectedShapes,
+                      const std::vector<tinyobj::material_t>& expectedMaterials) {
+    if(shapes.size() != expectedShapes.size() || materials.size() != expectedMaterials.size()) {
+        return false;
+    }
+    for(size_t i = 0; i < shapes.size(); ++i) {
+        const auto& mesh = shapes[i].mesh;
+        const auto& expected = expectedShapes[i].mesh;
+        if(shapes[i].name != expectedShapes[i].name || !isSameData(mesh.positions, expected.positions) ||
+           !isSameData(mesh.normals, expected.normals) || !isSameData(mesh.texcoords, expected.texcoords) ||
+           !isSameData(mesh.indices, expected.indices) || !isSameData(mesh.material_ids, expected.material_ids)) {
+            return false;
+        }
+    }
+    for(size_t i = 0; i < materials.size(); ++i) {
+        if(materials[i].name != expectedMaterials[i].name) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool checkLoaders() {
+    const std::string objPath = "./bench_selfcheck_chunks.obj", mtlName = "bench_selfcheck_chunks.mtl";
+    bool ok = writeChunkTest(objPath, mtlName);
+    std::vector<tinyobj::shape_t> expectedShapes, shapes;
+    std::vector<tinyobj::material_t> expectedMaterials, materials;
+    ok = ok && tinyobj::LoadObj(expectedShapes, expectedMaterials, objPath.c_str(), "./").empty();
+    size_t triangleCount = 0;
+    for(const auto& shape: expectedShapes) {
+        triangleCount += shape.mesh.indices.size() / 3;
+    }
+
+    size_t errors = !ok;
+    ok = ok && tinyobj::LoadObjMapped(shapes, materials, objPath.c_str(), "./").empty();
+    errors += !ok || !isSameOBJ(shapes, materials, expectedShapes, expectedMaterials);
+    std::string data;
+    {
+        std::ifstream file(objPath, std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    size_t inFaceRuns = 0, nextToGroups = 0;
+    for(auto threadCount: THREAD_COUNTS) {
+        shapes.clear();
+        materials.clear();
+        bool loaded = tinyobj::LoadObjParallel(shapes, materials, objPath.c_str(), "./", threadCount).empty();
+        errors += !loaded || !isSameOBJ(shapes, materials, expectedShapes, expectedMaterials);
+        countChunkStarts(data, threadCount, inFaceRuns, nextToGroups);
+    }
+    std::remove(objPath.c_str());
+    std::remove(mtlName.c_str());
+
+    // The file must put chunk boundaries in both places to test them
+    errors += !inFaceRuns + !nextToGroups;
+    printf("loaders: %zu shapes, %zu triangles, chunk starts %zu in face runs, %zu next to g/o/usemtl, %zu errors\n",
+           expectedShapes.size(), triangleCount, inFaceRuns, nextToGroups, errors);
+    return !errors;
+}
+
+static bool contains(const glimac::BBox3f& outer, const glimac::BBox3f& inner) {
+    return glm::all(glm::lessThanEqual(outer.lower, inner.lower)) && glm::all(glm::lessThanEqual(inner.upper, outer.upper));
+}
+
+// Each node reached once from the root, each triangle in one leaf
+static bool checkBVH(const glimac::Geometry& geometry, const glimac::BVH& bvh) {
+    auto pVertices = geometry.getVertexBuffer();
+    auto pIndices = geometry.getIndexBuffer();
+    auto triangleCount = geometry.getIndexCount() / 3;
+    auto pNodes = bvh.getNodes();
+    std::vector<unsigned int> nodeVisits(bvh.getNodeCount(), 0), triangleLeaves(triangleCount, 0);
+    size_t errors = 0;
+    if(bvh.getTriangleCount() != triangleCount) {
+        ++errors;
+    }
+    std::vector<unsigned int> stack;
+    if(bvh.getNodeCount()) {
+        stack.push_back(0);
+    }
+    while(!stack.empty()) {
+        auto n = stack.back();
+        stack.pop_back();
+        ++nodeVisits[n];
+        const auto& node = pNodes[n];
+        if(!node.isLeaf()) {
+            for(auto c = node.m_nOffset; c < node.m_nOffset + 2; ++c) {
+                errors += !contains(node.m_BBox, pNodes[c].m_BBox);
+                stack.push_back(c);
+            }
+            continue;
+        }
+        for(auto i = node.m_nOffset; i < node.m_nOffset + node.m_nCount; ++i) {
+            auto t = bvh.getTriangleIndices()[i];
+            if(t >= triangleCount) {
+                ++errors;
+                continue;
+            }
+            ++triangleLeaves[t];
+            for(auto k = 0u; k < 3; ++k) {
+                errors += !contains(node.m_BBox, glimac::BBox3f(pVertices[pIndices[3 * t + k]].m_Position));
+            }
+        }
+    }
+    errors += std::count_if(nodeVisits.begin(), nodeVisits.end(), [](unsigned int visits) { return visits != 1; });
+    errors += std::count_if(triangleLeaves.begin(), triangleLeaves.end(), [](unsigned int leaves) { return leaves != 1; });
+    printf("bvh: %zu nodes, %zu triangles, %zu errors\n", bvh.getNodeCount(), triangleCount, errors);
+    return !errors;
+}
+
+// Closest hit by testing every triangle, as BVH::intersect defines it
+static bool bruteForce(const glimac::Geometry& geometry, const glimac::BVH::Ray& ray, float& distance) {
+    auto pVertices = geometry.getVertexBuffer();
+    auto pIndices = geometry.getIndexBuffer();
+    bool hit = false;
+    distance = ray.m_TMax;
+    for(size_t t = 0; t < geometry.getIndexCount() / 3; ++t) {
+        auto p0 = pVertices[pIndices[3 * t]].m_Position;
+        auto e1 = pVertices[pIndices[3 * t + 1]].m_Position - p0, e2 = pVertices[pIndices[3 * t + 2]].m_Position - p0;
+        auto p = glm::cross(ray.m_Direction, e2);
+        float determinant = glm::dot(e1, p);
+        if(determinant == 0.f) {
+            continue;
+        }
+        auto s = ray.m_Origin - p0;
+        auto q = glm::cross(s, e1);
+        float u = glm::dot(s, p) / determinant, v = glm::dot(ray.m_Direction, q) / determinant;
+        float d = glm::dot(e2, q) / determinant;
+        if(u >= 0.f && v >= 0.f && u + v <= 1.f && d >= ray.m_TMin && d < distance) {
+            distance = d;
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+// Random segments and rays through the box, some of them along the axes
+static std::vector<glimac::BVH::Ray> randomRays(const glimac::BBox3f& box, size_t count) {
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<float> distribution(0.f, 1.f);
+    auto point = [&]() {
+        return box.lower + size(box) * glm::vec3(distribution(generator), distribution(generator), distribution(generator));
+    };
+    std::vector<glimac::BVH::Ray> rays(count);
+    for(size_t i = 0; i < count; ++i) {
+        auto origin = point();
+        auto direction = point() - origin;
+        if(i % 7 == 0) {
+            direction.x = 0.f;
+        }
+        if(i % 11 == 0) {
+            direction.y = direction.z = 0.f;
+        }
+        rays[i] = glimac::BVH::Ray(origin, direction, 0.f, i % 2 ? 1.f : std::numeric_limits<float>::infinity());
+    }
+    return rays;
+}
+
+// The hit agrees with the brute force one, and is on its triangle
+static bool isSameHit(const glimac::Geometry& geometry, const glimac::BVH::Ray& ray, const glimac::BVH::Hit& hit,
+                      bool expectedHit, float expectedDistance) {
+    if(hit.isHit() != expectedHit) {
+        return false;
+    }
+    if(!hit.isHit()) {
+        return true;
+    }
+    if(std::abs(hit.m_Distance - expectedDistance) > 1e-4f * std::max(1.f, expectedDistance)) {
+        return false;
+    }
+    const auto& mesh = geometry.getMeshBuffer()[hit.m_nMesh];
+    if(3 * hit.m_nTriangle < mesh.m_nIndexOffset || 3 * hit.m_nTriangle >= mesh.m_nIndexOffset + mesh.m_nIndexCount) {
+        return false;
+    }
+    auto pVertices = geometry.getVertexBuffer();
+    auto pTriangle = geometry.getIndexBuffer() + 3 * hit.m_nTriangle;
+    auto point = (1.f - hit.m_Barycentrics.x - hit.m_Barycentrics.y) * pVertices[pTriangle[0]].m_Position +
+                 hit.m_Barycentrics.x * pVertices[pTriangle[1]].m_Position +
+                 hit.m_Barycentrics.y * pVertices[pTriangle[2]].m_Position;
+    auto expected = ray.m_Origin + hit.m_Distance * ray.m_Direction;
+    return glm::length(point - expected) <= 1e-4f * glm::length(size(geometry.getBoundingBox()));
+}
+
+static bool checkQueries(const glimac::Geometry& geometry, const glimac::BVH& bvh) {
+    auto rays = randomRays(geometry.getBoundingBox(), RAY_COUNT);
+    size_t hitCount = 0, errors[3] = { 0, 0, 0 };
+    for(size_t i = 0; i < rays.size(); i += 8) {
+        glimac::BVH::Hit hits1[8], hits4[8], hits8[8];
+        bool occluded1[8], occluded4[8], occluded8[8];
+        for(auto k = 0u; k < 8; ++k) {
+            bvh.intersect(rays[i + k], hits1[k]);
+            occluded1[k] = bvh.occluded(rays[i + k]);
+        }
+        bvh.intersect4(&rays[i], hits4);
+        bvh.intersect4(&rays[i + 4], hits4 + 4);
+        bvh.intersect8(&rays[i], hits8);
+        bvh.occluded4(&rays[i], occluded4);
+        bvh.occluded4(&rays[i + 4], occluded4 + 4);
+        bvh.occluded8(&rays[i], occluded8);
+        for(auto k = 0u; k < 8; ++k) {
+            float distance;
+            bool hit = bruteForce(geometry, rays[i + k], distance);
+            hitCount += hit;
+            errors[0] += !isSameHit(geometry, rays[i + k], hits1[k], hit, distance) || occluded1[k] != hit;
+            errors[1] += !isSameHit(geometry, rays[i + k], hits4[k], hit, distance) || occluded4[k] != hit;
+            errors[2] += !isSameHit(geometry, rays[i + k], hits8[k], hit, distance) || occluded8[k] != hit;
+        }
+    }
+    printf("queries: %zu rays, %zu hits, %zu / %zu / %zu errors (1 / 4 / 8 wide)\n", rays.size(), hitCount,
+           errors[0], errors[1], errors[2]);
+    return !errors[0] && !errors[1] && !errors[2];
+}
+
+static bool checkIndexCodec(const glimac::Geometry& geometry) {
+    // The index buffer, then the extremes of the differences
+    std::vector<unsigned int> indices(geometry.getIndexBuffer(), geometry.getIndexBuffer() + geometry.getIndexCount());
+    indices.insert(indices.end(), { 0u, ~0u, 0u, 1u << 31, (1u << 31) - 1, ~0u, ~0u - 1, 7u });
+    std::vector<unsigned char> data;
+    glimac::Geometry::encodeIndices(indices.data(), indices.size(), data);
+    std::vector<unsigned int> decoded(indices.size());
+    auto bytes = glimac::Geometry::decodeIndices(data.data(), data.size(), decoded.data(), decoded.size());
+    bool ok = bytes == data.size() && decoded == indices;
+    // Truncated data
+    ok = ok && !glimac::Geometry::decodeIndices(data.data(), data.size() - 1, decoded.data(), decoded.size());
+    printf("index codec: %zu indices in %zu bytes, %s\n", indices.size(), data.size(), ok ? "ok" : "mismatch");
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    bool ok = checkLoaders();
+
+    glimac::Geometry geometry;
+    if(!bench::loadScene(geometry, argc, argv, "bench_selfcheck.obj", 20000, bench::FaceFormat::Normals,
+                         glimac::Geometry::OPTIMIZE_VERTEX_CACHE | glimac::Geometry::OPTIMIZE_VERTEX_FETCH)) {
+        return EXIT_FAILURE;
+    }
+
+    glimac::BVH bvh(geometry);
+    ok = checkBVH(geometry, bvh) && ok;
+    ok = checkQueries(geometry, bvh) && ok;
+    ok = checkIndexCodec(geometry) && ok;
+    printf("%s\n", ok ? "all checks passed" : "checks failed");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
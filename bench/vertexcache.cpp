@@ -0,0 +1,89 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <sstream>
+#include <iostream>
+#include "tiny_obj_loader.h"
+#include "bench.hpp"
+
+// Vertex deduplication benchmark: a v/vt/vn grid of 2 * n * n triangles,
+// with a usemtl switch every few rows so that face groups get flushed
+// inside each shape.
+
+class NullMaterialReader: public tinyobj::MaterialReader {
+public:
+    std::string operator() (const std::string&, std::vector<tinyobj::material_t>&,
+                            std::map<std::string, int>& matMap) {
+        matMap["a"] = 0;
+        matMap["b"] = 1;
+        return "";
+    }
+};
+
+static std::string buildGrid(int n) {
+    std::ostringstream obj;
+    obj << "mtllib grid.mtl\no grid\n";
+    for(int j = 0; j <= n; ++j) {
+        for(int i = 0; i <= n; ++i) {
+            obj << "v " << float(i) / n << " 0 " << float(j) / n << "\n";
+            obj << "vt " << float(i) / n << " " << float(j) / n << "\n";
+            obj << "vn 0 1 0\n";
+        }
+    }
+    for(int j = 0; j < n; ++j) {
+        if(j % 16 == 0) {
+            obj << "usemtl " << ((j / 16) % 2 ? "b" : "a") << "\n";
+        }
+        for(int i = 0; i < n; ++i) {
+            int a = j * (n + 1) + i + 1, b = a + 1, c = a + n + 2, d = a + n + 1;
+            obj << "f " << a << "/" << a << "/" << a << " " << b << "/" << b << "/" << b << " "
+                << c << "/" << c << "/" << c << "\n";
+            obj << "f " << a << "/" << a << "/" << a << " " << c << "/" << c << "/" << c << " "
+                << d << "/" << d << "/" << d << "\n";
+        }
+    }
+    return obj.str();
+}
+
+int main(int argc, char** argv) {
+    int n = argc > 1 ? atoi(argv[1]) : 1024;
+
+    std::string obj = buildGrid(n);
+
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    NullMaterialReader materialReader;
+
+    // Best of a few runs, allocations are the same for every run
+    double seconds = 1e30;
+    unsigned long long allocations = 0, bytes = 0;
+    for(int run = 0; run < 3; ++run) {
+        std::istringstream stream(obj);
+        shapes.clear();
+        materials.clear();
+
+        allocations = bench::allocationCount();
+        bytes = bench::allocatedBytes();
+        bench::Timer timer;
+        std::string err = tinyobj::LoadObj(shapes, materials, stream, materialReader);
+        seconds = std::min(seconds, timer.elapsed());
+        allocations = bench::allocationCount() - allocations;
+        bytes = bench::allocatedBytes() - bytes;
+
+        if(!err.empty()) {
+            std::cerr << err << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    size_t vertexCount = 0, triangleCount = 0;
+    for(const auto& shape: shapes) {
+        vertexCount += shape.mesh.positions.size() / 3;
+        triangleCount += shape.mesh.indices.size() / 3;
+    }
+
+    printf("triangles %zu vertices %zu time %.3f s allocations %llu allocated %.1f MB\n",
+           triangleCount, vertexCount, seconds, allocations, bytes / (1024. * 1024.));
+
+    return EXIT_SUCCESS;
+}
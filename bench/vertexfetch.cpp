@@ -0,0 +1,57 @@
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <string>
+#include "glimac/Geometry.hpp"
+#include "bench.hpp"
+#include "scene.hpp"
+
+// Vertex fetch benchmark: a CPU pass over the triangles of a geometry, as
+// done by normal generation, before and after Geometry::optimizeVertexFetch.
+// The triangles are first reordered by optimizeVertexCache, which leaves the
+// vertices in OBJ order.
+//
+// usage: bench_vertexfetch [file.obj]
+// Without a file, a synthetic scene of 1M triangles is written and used.
+
+// Best of a few runs of a face normal pass over all the triangles
+static double trianglePass(const glimac::Geometry& geometry, float& checksum) {
+    auto pVertices = geometry.getVertexBuffer();
+    auto pIndices = geometry.getIndexBuffer();
+    double seconds = 1e30;
+    for(int run = 0; run < 5; ++run) {
+        glm::vec3 sum(0.f);
+        bench::Timer timer;
+        for(size_t i = 0; i + 2 < geometry.getIndexCount(); i += 3) {
+            const auto& a = pVertices[pIndices[i]].m_Position;
+            const auto& b = pVertices[pIndices[i + 1]].m_Position;
+            const auto& c = pVertices[pIndices[i + 2]].m_Position;
+            sum += glm::cross(b - a, c - a);
+        }
+        seconds = std::min(seconds, timer.elapsed());
+        checksum = sum.x + sum.y + sum.z;
+    }
+    return seconds;
+}
+
+int main(int argc, char** argv) {
+    glimac::Geometry geometry;
+    if(!bench::loadScene(geometry, argc, argv, "bench_vertexfetch.obj", 1000000, bench::FaceFormat::Normals,
+                         glimac::Geometry::OPTIMIZE_VERTEX_CACHE)) {
+        return EXIT_FAILURE;
+    }
+
+    float checksumBefore, checksumAfter;
+    auto missesBefore = geometry.getVertexFetchMissRatio();
+    auto secondsBefore = trianglePass(geometry, checksumBefore);
+    geometry.optimizeVertexFetch();
+    auto missesAfter = geometry.getVertexFetchMissRatio();
+    auto secondsAfter = trianglePass(geometry, checksumAfter);
+
+    printf("triangles %zu vertices %zu\n", geometry.getIndexCount() / 3, geometry.getVertexCount());
+    printf("cache line misses per triangle %.3f -> %.3f\n", missesBefore, missesAfter);
+    printf("triangle pass %.3f ms -> %.3f ms (checksum %g / %g)\n",
+           secondsBefore * 1e3, secondsAfter * 1e3, checksumBefore, checksumAfter);
+
+    return EXIT_SUCCESS;
+}
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <limits>
 #include "glm.hpp"
 
 namespace glimac {
@@ -99,4 +100,21 @@ inline void boundingSphere(const BBox3f& bbox, glm::vec3& c,
     radius = glm::length(size(bbox)) * 0.5f;
 }
 
+/*! size in pixels of the projection of the box on a viewport of the given size:
+    diagonal of its screen space bounding rectangle, infinite if the box crosses
+    the near plane */
+inline float projectedSize(const BBox3f& box, const glm::mat4& viewProjMatrix, const glm::vec2& viewportSize) {
+    glm::vec2 lower(std::numeric_limits<float>::max()), upper(-std::numeric_limits<float>::max());
+    for (auto i = 0u; i < 8; i++) {
+        glm::vec4 corner(i & 1 ? box.upper.x : box.lower.x, i & 2 ? box.upper.y : box.lower.y,
+                         i & 4 ? box.upper.z : box.lower.z, 1.f);
+        glm::vec4 p = viewProjMatrix * corner;
+        if (p.w <= 0.f) return std::numeric_limits<float>::infinity();
+        glm::vec2 ndc = glm::vec2(p) / p.w;
+        lower = glm::min(lower, ndc);
+        upper = glm::max(upper, ndc);
+    }
+    return glm::length(.5f * (upper - lower) * viewportSize);
+}
+
 }
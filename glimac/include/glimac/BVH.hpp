@@ -0,0 +1,151 @@
+#pragma once
+
+#include <limits>
+#include <vector>
+#include "BBox.hpp"
+#include "Geometry.hpp"
+
+namespace glimac {
+
+// Bounding volume hierarchy over the triangles of a Geometry, built with a
+// binned SAH (Wald 2007). Triangle t is the one of indices 3 * t to
+// 3 * t + 2 in the index buffer of the geometry. The BVH holds no reference
+// to the geometry and must be built again when its triangles change.
+//
+// Rays are queried for the closest hit (picking, baking, CPU rendering) or
+// for any hit (occlusion), one at a time or by packets of 4 or 8 tested
+// together with SIMD, which pays off when the rays of a packet are coherent
+// as for the pixels of a tile.
+class BVH {
+public:
+    // The children of an inner node are consecutive, the triangles of a leaf
+    // are consecutive in the triangle index buffer
+    struct Node {
+        BBox3f m_BBox;
+        unsigned int m_nOffset; // First child for inner nodes, first triangle for leaves
+        unsigned int m_nCount; // Number of triangles, 0 for inner nodes
+
+        bool isLeaf() const {
+            return m_nCount != 0;
+        }
+    };
+
+    // Points m_Origin + t * m_Direction for t in [m_TMin, m_TMax]. The
+    // direction needs not be normalized, distances are in its units.
+    struct Ray {
+        glm::vec3 m_Origin;
+        glm::vec3 m_Direction;
+        float m_TMin;
+        float m_TMax;
+
+        Ray() {
+        }
+
+        Ray(const glm::vec3& origin, const glm::vec3& direction, float tMin = 0.f,
+            float tMax = std::numeric_limits<float>::infinity()):
+            m_Origin(origin), m_Direction(direction), m_TMin(tMin), m_TMax(tMax) {
+        }
+    };
+
+    static const unsigned int NO_HIT = ~0u;
+
+    struct Hit {
+        float m_Distance; // t of the hit point along the ray
+        unsigned int m_nTriangle; // In the geometry, NO_HIT if the ray hits nothing
+        unsigned int m_nMesh; // In the mesh buffer of the geometry, NO_HIT if in none
+        glm::vec2 m_Barycentrics; // Weights of the second and third vertices of the triangle
+
+        bool isHit() const {
+            return m_nTriangle != NO_HIT;
+        }
+    };
+
+    static const unsigned int DEFAULT_MAX_LEAF_SIZE = 4;
+    // Relative costs of the SAH, a traversal step and a triangle test
+    static constexpr float TRAVERSAL_COST = 1.f;
+    static constexpr float INTERSECTION_COST = 1.f;
+
+    BVH(): m_nDepth(0) {
+    }
+
+    explicit BVH(const Geometry& geometry, unsigned int maxLeafSize = DEFAULT_MAX_LEAF_SIZE): m_nDepth(0) {
+        build(geometry, maxLeafSize);
+    }
+
+    // Replaces the hierarchy by one over the triangles of geometry, with at
+    // most maxLeafSize triangles per leaf unless they can't be told apart.
+    // The top levels are split on the calling thread, then the subtrees
+    // below are built in parallel.
+    void build(const Geometry& geometry, unsigned int maxLeafSize = DEFAULT_MAX_LEAF_SIZE);
+
+    // The root is node 0, if there is one
+    const Node* getNodes() const {
+        return m_Nodes.data();
+    }
+
+    size_t getNodeCount() const {
+        return m_Nodes.size();
+    }
+
+    // Triangles in leaf order
+    const unsigned int* getTriangleIndices() const {
+        return m_TriangleIndices.data();
+    }
+
+    size_t getTriangleCount() const {
+        return m_TriangleIndices.size();
+    }
+
+    // Expected cost of a ray query under the SAH: the area of each node
+    // relative to the root's, times TRAVERSAL_COST for the inner nodes and
+    // times INTERSECTION_COST per triangle for the leaves
+    float getSAHCost() const;
+
+    // Closest hit of ray, both sides of the triangles count. Returns
+    // hit.isHit().
+    bool intersect(const Ray& ray, Hit& hit) const;
+
+    // Whether ray hits any triangle, stopping at the first one found
+    bool occluded(const Ray& ray) const;
+
+    // Closest hits of the 4 or 8 rays of a packet
+    void intersect4(const Ray* pRays, Hit* pHits) const;
+    void intersect8(const Ray* pRays, Hit* pHits) const;
+
+    // Occlusion of the 4 or 8 rays of a packet
+    void occluded4(const Ray* pRays, bool* pOccluded) const;
+    void occluded8(const Ray* pRays, bool* pOccluded) const;
+
+private:
+    // First vertex and edges of a triangle, in leaf order for the queries
+    struct Triangle {
+        glm::vec3 m_Vertex;
+        glm::vec3 m_Edge1;
+        glm::vec3 m_Edge2;
+    };
+
+    // Node of the 4-wide hierarchy that the queries traverse, collapsed from
+    // the binary one so that a single ray tests 4 boxes at once: the bounds
+    // of the children by axis, one lane per child
+    struct QueryNode {
+        float m_Lower[3][4];
+        float m_Upper[3][4];
+        unsigned int m_nChildren[4]; // Query node, or first triangle of a leaf
+        unsigned int m_nCounts[4]; // Number of triangles, 0 for query nodes
+        unsigned int m_nChildCount;
+    };
+
+    void buildQueryNodes();
+
+    template<typename Float, bool ANY_HIT>
+    void traverse(const Ray* pRays, Hit* pHits, bool* pOccluded) const;
+
+    std::vector<Node> m_Nodes;
+    std::vector<unsigned int> m_TriangleIndices;
+    std::vector<QueryNode> m_QueryNodes;
+    std::vector<Triangle> m_Triangles;
+    std::vector<unsigned int> m_TriangleMeshes; // Mesh of each triangle in leaf order
+    unsigned int m_nDepth; // Levels of query nodes, bounds the traversal stack
+};
+
+}
@@ -1,14 +1,25 @@
 #pragma once
 
+#include <GL/glew.h>
 #include <glm/glm.hpp>
+#include <cstdint>
 #include <vector>
 #include <string>
+#include <atomic>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "Image.hpp"
 #include "FilePath.hpp"
 #include "BBox.hpp"
 
 namespace glimac {
 
+// Peak resident set size of the process in bytes, 0 if unknown
+size_t peakResidentSetSize();
+
 class Geometry {
 public:
     struct Vertex {
@@ -17,14 +28,84 @@ public:
         glm::vec2 m_TexCoords;
     };
 
+    // Compact copy of a Vertex, see packVertices
+    struct PackedVertex {
+        uint16_t m_Position[4]; // Unsigned normalized in the packing box of the mesh, w = 1
+        uint32_t m_Normal; // Signed normalized 10:10:10:2
+        uint16_t m_TexCoords[2]; // Half floats
+    };
+
+    // Arguments of glVertexAttribPointer for one attribute of a vertex format
+    struct VertexAttribute {
+        GLint m_nSize;
+        GLenum m_Type;
+        GLboolean m_bNormalized;
+        GLsizei m_nStride;
+        const GLvoid* m_pOffset;
+    };
+
+    // Order of the attributes in VERTEX_ATTRIBUTES and PACKED_VERTEX_ATTRIBUTES
+    enum VertexAttributeIndex {
+        POSITION_ATTRIBUTE,
+        NORMAL_ATTRIBUTE,
+        TEXCOORDS_ATTRIBUTE,
+        VERTEX_ATTRIBUTE_COUNT
+    };
+
+    static const VertexAttribute VERTEX_ATTRIBUTES[VERTEX_ATTRIBUTE_COUNT];
+    static const VertexAttribute PACKED_VERTEX_ATTRIBUTES[VERTEX_ATTRIBUTE_COUNT];
+    static const VertexAttribute POSITION_BUFFER_ATTRIBUTE; // Position of the position buffer
+
     struct Mesh {
         std::string m_sName;
         unsigned int m_nIndexOffset; // Offset in the index buffer
         unsigned int m_nIndexCount; // Number of indices
         int m_nMaterialIndex; // -1 if no material assigned
+        unsigned int m_nMeshletOffset; // Offset in the meshlet buffer, see buildMeshlets
+        unsigned int m_nMeshletCount; // 0 until meshlets are built
+        unsigned int m_nLodOffset; // Offset in the LOD buffer, see buildLods
+        unsigned int m_nLodCount; // Simplified levels, the mesh itself not included
+        unsigned int m_nBaseVertex; // Lowest vertex used by the mesh, see narrowIndices
+        bool m_bShortIndices; // Has 16-bit indices relative to m_nBaseVertex, see narrowIndices
 
         Mesh(std::string name, unsigned int indexOffset, unsigned int indexCount, int materialIndex):
-            m_sName(move(name)), m_nIndexOffset(indexOffset), m_nIndexCount(indexCount), m_nMaterialIndex(materialIndex) {
+            m_sName(move(name)), m_nIndexOffset(indexOffset), m_nIndexCount(indexCount), m_nMaterialIndex(materialIndex),
+            m_nMeshletOffset(0), m_nMeshletCount(0), m_nLodOffset(0), m_nLodCount(0), m_nBaseVertex(0),
+            m_bShortIndices(false) {
+        }
+    };
+
+    // Bounds of the vertices used by a mesh, see getMeshBounds
+    struct MeshBounds {
+        BBox3f m_BBox;
+        glm::vec3 m_SphereCenter; // Center of m_BBox
+        float m_SphereRadius; // Distance to the farthest vertex
+    };
+
+    // Simplified level of a mesh, drawn with the vertices of the geometry
+    struct Lod {
+        unsigned int m_nIndexOffset; // Offset in the LOD index buffer
+        unsigned int m_nIndexCount;
+        float m_Error; // Quadric estimate of the distance to the original surface, in object units
+    };
+
+    // Small cluster of triangles of a mesh, with the bounds to cull it as a whole
+    struct Meshlet {
+        unsigned int m_nVertexOffset; // Offset in the meshlet vertex buffer
+        unsigned int m_nVertexCount;
+        unsigned int m_nTriangleOffset; // Offset in the meshlet triangle buffer, in triangles
+        unsigned int m_nTriangleCount;
+        BBox3f m_BBox;
+        glm::vec3 m_SphereCenter;
+        float m_SphereRadius;
+        // Normal cone: all the triangles face away from viewpoints in the cone
+        // of apex m_ConeApex, axis m_ConeAxis and cosine m_ConeCutoff.
+        glm::vec3 m_ConeApex;
+        glm::vec3 m_ConeAxis;
+        float m_ConeCutoff; // 1 if the normals are too spread to cull
+
+        bool isBackfacing(const glm::vec3& viewpoint) const {
+            return glm::dot(glm::normalize(m_ConeApex - viewpoint), m_ConeAxis) >= m_ConeCutoff;
         }
     };
 
@@ -37,28 +118,194 @@ public:
         float m_Shininess;
         float m_RefractionIndex;
         float m_Dissolve;
-        const Image* m_pKaMap;
-        const Image* m_pKdMap;
-        const Image* m_pKsMap;
-        const Image* m_pNormalMap;
+        FilePath m_KaMapPath;
+        FilePath m_KdMapPath;
+        FilePath m_KsMapPath;
+        FilePath m_NormalMapPath;
+        const Image* m_pKaMap = nullptr;
+        const Image* m_pKdMap = nullptr;
+        const Image* m_pKsMap = nullptr;
+        const Image* m_pNormalMap = nullptr;
+    };
+
+    // Progress of a load, written by the loading thread and readable from any other
+    struct LoadProgress {
+        std::atomic<size_t> m_nParsedBytes { 0 };
+        std::atomic<size_t> m_nTotalBytes { 0 };
+        std::atomic<unsigned int> m_nDecodedTextures { 0 };
+        std::atomic<unsigned int> m_nTextureCount { 0 };
+        std::atomic<bool> m_bCancelled { false }; // Set to stop the load as soon as possible
+    };
+
+    // Piece of a mesh produced by streamOBJ, indices are relative to m_pVertices
+    struct MeshChunk {
+        std::string m_sName;
+        int m_nMaterialIndex; // In the materials filled by streamOBJ, -1 if none
+        const Vertex* m_pVertices;
+        size_t m_nVertexCount;
+        const unsigned int* m_pIndices;
+        size_t m_nIndexCount;
+        bool m_bEndOfMesh; // Last chunk of a run of triangles sharing a shape and a material
+    };
+
+    // Options of loadOBJ, combined with |. The processing ones are baked into
+    // the binary cache, which is rebuilt when they change.
+    enum LoadOption {
+        LOAD_TEXTURES = 1 << 0, // Decode the texture images of the materials
+        OPTIMIZE_VERTEX_CACHE = 1 << 1, // Reorder the triangles of each mesh, see optimizeVertexCache
+        OPTIMIZE_VERTEX_FETCH = 1 << 2, // Reorder the vertices after that, see optimizeVertexFetch
+        BUILD_MESHLETS = 1 << 3, // Split the meshes in meshlets of default size, not cached
+        BUILD_LODS = 1 << 4, // Build the default LOD chain of each mesh, not cached
+        GENERATE_TANGENTS = 1 << 5, // Fill the tangent buffer, see generateTangents, not cached
+        PACK_VERTICES = 1 << 6, // Fill the packed vertex buffer, see packVertices, not cached
+        RELEASE_VERTEX_BUFFER = 1 << 7, // Keep only the packed vertices at the end, see releaseVertexBuffer
+        NARROW_INDICES = 1 << 8, // Fill the 16-bit index buffer, see narrowIndices, not cached
+        BUILD_POSITION_BUFFER = 1 << 9, // Fill the position buffer, see buildPositionBuffer, not cached
+        WELD_VERTICES = 1 << 10 // Merge the vertices repeated by the faces first, see weldVertices
+    };
+
+    // Post-transform vertex cache efficiency, simulated with a FIFO cache
+    struct VertexCacheStats {
+        float m_ACMR; // Average cache miss ratio: vertex shader runs per triangle, 0.5 at best
+        float m_ATVR; // Average transformed vertex ratio: vertex shader runs per vertex, 1 at best
+    };
+
+    static const unsigned int DEFAULT_VERTEX_CACHE_SIZE = 16;
+    static const unsigned int DEFAULT_MESHLET_VERTEX_COUNT = 64;
+    static const unsigned int DEFAULT_MESHLET_TRIANGLE_COUNT = 124;
+    static constexpr float DEFAULT_CREASE_ANGLE = 1.04719755f; // 60 degrees
+    static constexpr float DEFAULT_WELD_POSITION_TOLERANCE = 1e-5f; // Of the bounding box diagonal
+    static constexpr float DEFAULT_WELD_NORMAL_ANGLE = .0174532925f; // 1 degree
+    static constexpr float DEFAULT_WELD_TEXCOORDS_TOLERANCE = 1e-4f;
+
+    struct StreamOptions {
+        unsigned int m_nMaxChunkTriangles;
+        // Bound on the chunk buffers and on the part of the file kept in memory.
+        // The OBJ attribute pools (12 bytes per position or normal, 8 per
+        // texcoord) come on top of it since faces can reference any of them.
+        size_t m_nMemoryCeiling;
+
+        StreamOptions(): m_nMaxChunkTriangles(1 << 16), m_nMemoryCeiling(64 << 20) {
+        }
     };
 
 private:
     std::vector<Vertex> m_VertexBuffer;
     std::vector<unsigned int> m_IndexBuffer;
+    std::vector<uint16_t> m_ShortIndexBuffer; // Empty or one per index, see narrowIndices
+    std::vector<glm::vec3> m_PositionBuffer; // Empty or one per vertex, see buildPositionBuffer
+    std::vector<glm::vec4> m_TangentBuffer; // Empty or one per vertex
+    std::vector<PackedVertex> m_PackedVertexBuffer; // Empty or one per vertex
+    std::vector<BBox3f> m_PackingBoxes; // One per mesh with the packed vertex buffer
     std::vector<Mesh> m_MeshBuffer;
-    std::vector<Material> m_Materials;
-    BBox3f m_BBox;
+    std::vector<MeshBounds> m_MeshBounds; // One per mesh
+    std::vector<Meshlet> m_MeshletBuffer;
+    std::vector<unsigned int> m_MeshletVertexBuffer; // Indices in m_VertexBuffer
+    std::vector<unsigned char> m_MeshletTriangleBuffer; // 3 indices in the vertices of the meshlet per triangle
+    std::vector<Lod> m_LodBuffer;
+    std::vector<unsigned int> m_LodIndexBuffer; // Indices in m_VertexBuffer
+    std::vector<const Material*> m_Materials; // Shared through MaterialManager
+    std::unordered_map<const Material*, int> m_MaterialIndices;
+    // Lower above upper until something is loaded
+    BBox3f m_BBox = BBox3f(glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()));
 
-    void generateNormals(unsigned int meshIndex);
+    // Computes the bounds of the meshes from meshOffset on
+    void computeMeshBounds(size_t meshOffset);
+
+    // Smooth normals of the vertices of a range of the index buffer, see generateNormals
+    void generateNormals(size_t indexOffset, size_t indexCount, float creaseAngle);
+
+    // Moves each vertex v to newIndices[v] after copies of the vertices
+    // copySources were appended, remapping the indices and filling the other
+    // vertex streams
+    void insertVertexCopies(const std::vector<unsigned int>& newIndices, const std::vector<unsigned int>& copySources);
+
+    // Copies the positions of the vertices from vertexOffset on, or from the
+    // end of the position buffer if it is shorter
+    void buildPositionBuffer(size_t vertexOffset);
+
+    // Tangents of the vertices of a range of the index buffer, see generateTangents
+    void generateTangents(size_t indexOffset, size_t indexCount);
+
+    // Welds the vertices from vertexOffset on used by the meshes from
+    // meshOffset on and logs the gain
+    void weldVertices(size_t vertexOffset, size_t meshOffset, float positionTolerance, float normalAngle,
+                      float texCoordsTolerance);
+
+    // Optimizes the meshes from meshOffset on and logs the gain
+    void optimizeVertexCache(size_t meshOffset, unsigned int cacheSize);
+
+    // Reorders the vertices from vertexOffset on, used by the meshes from
+    // meshOffset on, and logs the gain
+    void optimizeVertexFetch(size_t vertexOffset, size_t meshOffset);
+
+    // Appends the meshlets of the meshes from meshOffset on
+    void buildMeshlets(size_t meshOffset, unsigned int maxVertexCount, unsigned int maxTriangleCount);
+
+    // Appends the LOD chains of the meshes from meshOffset on
+    void buildLods(size_t meshOffset, const std::vector<float>& ratios, float maxError);
+
+    // Index of the shared copy of material in m_Materials, added if needed
+    int addMaterial(const Material& material);
+
+    // materialIndices receives the index in m_Materials of each material of the file,
+    // mtlPaths the .mtl files it read
+    bool parseOBJ(const FilePath& filepath, const FilePath& mtlBasePath, LoadProgress* pProgress,
+                  std::vector<int>& materialIndices, std::vector<std::string>& mtlPaths);
+
+    // Returns false if the load was cancelled
+    bool loadMaterialTextures(const Material* pMaterial, LoadProgress* pProgress);
+
+    // Appends the content of the binary cache of filepath if it is up to date, with
+    // its .mtl files, and was made with the same mtlBasePath
+    bool loadCache(const FilePath& cachePath, const FilePath& filepath, const FilePath& mtlBasePath,
+                   unsigned int options, LoadProgress* pProgress, std::vector<int>& materialIndices);
+
+    // Removes what was appended since the given offsets
+    void truncate(size_t vertexOffset, size_t indexOffset, size_t meshOffset, size_t materialOffset);
+
+    // Writes what was appended since the given offsets to the binary cache
+    void saveCache(const FilePath& cachePath, const FilePath& filepath, const FilePath& mtlBasePath,
+                   const std::vector<std::string>& mtlPaths, unsigned int options,
+                   size_t vertexOffset, size_t indexOffset, size_t meshOffset,
+                   const std::vector<int>& materialIndices) const;
 
 public:
+    // Null after releaseVertexBuffer
     const Vertex* getVertexBuffer() const {
-        return m_VertexBuffer.data();
+        return m_VertexBuffer.empty() ? nullptr : m_VertexBuffer.data();
     }
 
     size_t getVertexCount() const {
-        return m_VertexBuffer.size();
+        return m_VertexBuffer.empty() ? m_PackedVertexBuffer.size() : m_VertexBuffer.size();
+    }
+
+    // Null until buildPositionBuffer is called
+    const glm::vec3* getPositionBuffer() const {
+        return m_PositionBuffer.empty() ? nullptr : m_PositionBuffer.data();
+    }
+
+    // Null until packVertices is called
+    const PackedVertex* getPackedVertexBuffer() const {
+        return m_PackedVertexBuffer.empty() ? nullptr : m_PackedVertexBuffer.data();
+    }
+
+    // Box in which the packed positions of mesh meshIndex are quantized
+    const BBox3f& getPackingBox(unsigned int meshIndex) const {
+        return m_PackingBoxes[meshIndex];
+    }
+
+    // Model matrix taking the packed positions of mesh meshIndex, in [0, 1],
+    // to the positions of the geometry
+    glm::mat4 getPackingMatrix(unsigned int meshIndex) const {
+        const auto& box = m_PackingBoxes[meshIndex];
+        return glm::scale(glm::translate(glm::mat4(1.f), box.lower), box.size());
+    }
+
+    // Tangent of each vertex, bitangent sign in w: the bitangent is
+    // w * cross(normal, tangent). Null until tangents are generated.
+    const glm::vec4* getTangentBuffer() const {
+        return m_TangentBuffer.empty() ? nullptr : m_TangentBuffer.data();
     }
 
     const unsigned int* getIndexBuffer() const {
@@ -69,6 +316,11 @@ public:
         return m_IndexBuffer.size();
     }
 
+    // Null until narrowIndices is called. Same offsets as the index buffer.
+    const uint16_t* getShortIndexBuffer() const {
+        return m_ShortIndexBuffer.empty() ? nullptr : m_ShortIndexBuffer.data();
+    }
+
     const Mesh* getMeshBuffer() const {
         return m_MeshBuffer.data();
     }
@@ -77,11 +329,258 @@ public:
         return m_MeshBuffer.size();
     }
 
-    bool loadOBJ(const FilePath& filepath, const FilePath& mtlBasePath, bool loadTextures = true);
+    // Computed by loadOBJ, for culling each mesh without reading its vertices
+    const MeshBounds& getMeshBounds(unsigned int meshIndex) const {
+        return m_MeshBounds[meshIndex];
+    }
+
+    const Meshlet* getMeshletBuffer() const {
+        return m_MeshletBuffer.data();
+    }
+
+    size_t getMeshletCount() const {
+        return m_MeshletBuffer.size();
+    }
+
+    const unsigned int* getMeshletVertexBuffer() const {
+        return m_MeshletVertexBuffer.data();
+    }
+
+    const unsigned char* getMeshletTriangleBuffer() const {
+        return m_MeshletTriangleBuffer.data();
+    }
+
+    const Lod* getLodBuffer() const {
+        return m_LodBuffer.data();
+    }
+
+    size_t getLodCount() const {
+        return m_LodBuffer.size();
+    }
+
+    const unsigned int* getLodIndexBuffer() const {
+        return m_LodIndexBuffer.data();
+    }
+
+    const Material& getMaterial(unsigned int materialIndex) const {
+        return *m_Materials[materialIndex];
+    }
+
+    size_t getMaterialCount() const {
+        return m_Materials.size();
+    }
+
+    // Loads an OBJ file and appends its content to the geometry.
+    // The result is cached in a binary file next to it (filepath + ".gmesh")
+    // that is used instead of the OBJ while mtlBasePath is the same and the
+    // size and timestamp, or the content hash, of the OBJ and of its .mtl
+    // files match.
+    // options is a combination of LoadOption; true and false still mean
+    // loading the textures or not.
+    // If pProgress is given, it is updated during the load, which stops and
+    // returns false with the geometry unchanged once m_bCancelled is set.
+    bool loadOBJ(const FilePath& filepath, const FilePath& mtlBasePath, unsigned int options = LOAD_TEXTURES,
+                 LoadProgress* pProgress = nullptr);
+
+    // Replaces the normals of all the vertices by smooth ones, the normals of
+    // the faces around each vertex weighted by their area and by their angle
+    // at the vertex. Vertices at the same position share their normal, except
+    // across edges sharper than creaseAngle where they are split. OBJ shapes
+    // without normals get them at load time with DEFAULT_CREASE_ANGLE.
+    // Split vertices go right after the vertices of their shape, which keep
+    // a contiguous range. Meshlets and LODs built before keep the vertices
+    // as they were.
+    void generateNormals(float creaseAngle = DEFAULT_CREASE_ANGLE) {
+        generateNormals(0, m_IndexBuffer.size(), creaseAngle);
+    }
+
+    // Computes the tangent buffer for normal mapping in the MikkTSpace
+    // convention: per face tangents from the texture coordinates, weighted
+    // by the angle of each corner, orthonormalized against the vertex normal.
+    // Like MikkTSpace it splits the vertices shared by mirrored faces and
+    // other faces, the copies going right after the vertices of their shape.
+    // optimizeVertexFetch keeps it in sync, generateNormals doesn't.
+    void generateTangents() {
+        generateTangents(0, m_IndexBuffer.size());
+    }
+
+    // Merges the vertices of a shape that are closer than positionTolerance
+    // times the diagonal of the bounding box, with normals less than
+    // normalAngle apart and texture coordinates closer than
+    // texCoordsTolerance on each axis, then removes the merged ones. This
+    // undoes the exporters that write the vertices once per face. Neighbours
+    // are found in parallel with a spatial hash of cells twice the tolerance
+    // wide; each vertex goes where its lowest matching one went when that
+    // vertex matches it too, and stays otherwise, so none moves too far.
+    // The indices, meshlets, LODs and the vertex streams in sync with the
+    // vertex buffer are rewritten in place.
+    void weldVertices(float positionTolerance = DEFAULT_WELD_POSITION_TOLERANCE,
+                      float normalAngle = DEFAULT_WELD_NORMAL_ANGLE,
+                      float texCoordsTolerance = DEFAULT_WELD_TEXCOORDS_TOLERANCE) {
+        weldVertices(0, 0, positionTolerance, normalAngle, texCoordsTolerance);
+    }
+
+    // Fills the position buffer, a copy of the positions of the vertices
+    // packed 12 bytes apart, for the passes that only need positions: depth
+    // and shadow passes bind it with POSITION_BUFFER_ATTRIBUTE, CPU passes
+    // read 5 positions per cache line instead of 2. Vertices appended by
+    // loadOBJ and generateNormals are added to it and optimizeVertexFetch
+    // keeps it in sync once it exists.
+    void buildPositionBuffer() {
+        buildPositionBuffer(0);
+    }
+
+    // Fills the packed vertex buffer, 16 bytes per vertex instead of 32:
+    // positions quantized to 16 bits in the bounds of the vertices of the
+    // mesh, or of the meshes that share vertices with it, normals in 10 bits
+    // per component and texture coordinates as half floats. It is drawn with
+    // PACKED_VERTEX_ATTRIBUTES and getPackingMatrix, and must be built again
+    // after any pass that changes the vertices.
+    void packVertices();
+
+    // Refills the vertex buffer from the packed one, with the precision of
+    // the packing
+    void unpackVertices();
+
+    // Frees the vertex buffer once packVertices has run, halving the memory
+    // of the vertices. The passes on the vertices and the BVH need it back
+    // with unpackVertices; loadOBJ does it before appending.
+    void releaseVertexBuffer();
+
+    static PackedVertex packVertex(const Vertex& vertex, const BBox3f& packingBox);
+    static Vertex unpackVertex(const PackedVertex& vertex, const BBox3f& packingBox);
+
+    // Sets the base vertex of each mesh and fills the 16-bit index buffer
+    // with the indices relative to it for the meshes that use less than 64K
+    // consecutive vertices, usually all of them after optimizeVertexFetch.
+    // A mesh with m_bShortIndices is drawn with glDrawElementsBaseVertex,
+    // GL_UNSIGNED_SHORT and the byte offset 2 * m_nIndexOffset, the others
+    // with the 32-bit index buffer. Must be called again after any pass that
+    // changes the indices.
+    void narrowIndices();
+
+    // Compressed index stream for storage, as in the binary cache: each index
+    // is the zigzag encoded difference with the previous one, in a varint of
+    // 7 bits per byte. Indices ordered by optimizeVertexCache and
+    // optimizeVertexFetch take about 1.1 bytes each.
+    static void encodeIndices(const unsigned int* pIndices, size_t count, std::vector<unsigned char>& data);
+
+    // Decodes count indices, returns the number of bytes read or 0 if the
+    // data is truncated or malformed
+    static size_t decodeIndices(const unsigned char* pData, size_t size, unsigned int* pIndices, size_t count);
+
+    // Simulates a FIFO vertex cache of cacheSize entries over each mesh
+    VertexCacheStats getVertexCacheStats(unsigned int cacheSize = DEFAULT_VERTEX_CACHE_SIZE) const;
+
+    // Reorders the triangles of each mesh for the post-transform vertex cache
+    // with Tipsify (Sander et al. 2007), which works for any cache size close
+    // to cacheSize. The meshes are processed in parallel.
+    void optimizeVertexCache(unsigned int cacheSize = DEFAULT_VERTEX_CACHE_SIZE) {
+        optimizeVertexCache(0, cacheSize);
+    }
+
+    // Cache lines missed per triangle when reading the vertices of each
+    // triangle in index order, simulated with a 32 KB direct mapped cache
+    // that also loads the next line on a miss, like hardware prefetchers
+    float getVertexFetchMissRatio() const;
+
+    // Renumbers the vertices in the order of their first use by the meshes,
+    // so that walking the triangles reads the vertex buffer almost linearly.
+    // Best done after optimizeVertexCache, which decides that order. The
+    // meshlets, LODs, 16-bit indices and vertex streams built before follow.
+    void optimizeVertexFetch() {
+        optimizeVertexFetch(0, 0);
+    }
 
+    // Splits each mesh in meshlets of at most maxVertexCount vertices (256 at
+    // most) and maxTriangleCount triangles, in index order, replacing the
+    // previous ones. Triangle j of a meshlet m uses the vertices
+    // getMeshletVertexBuffer()[m.m_nVertexOffset + t[k]] with
+    // t = getMeshletTriangleBuffer() + 3 * (m.m_nTriangleOffset + j).
+    // The meshlets are tighter after optimizeVertexCache, and must be built
+    // again after any pass that reorders the triangles or the vertices.
+    void buildMeshlets(unsigned int maxVertexCount = DEFAULT_MESHLET_VERTEX_COUNT,
+                       unsigned int maxTriangleCount = DEFAULT_MESHLET_TRIANGLE_COUNT);
+
+    // Builds a chain of simplified levels for each mesh, replacing the
+    // previous ones: level i aims at ratios[i] of the triangles of the mesh,
+    // and the chain stops early once the error would exceed maxError times
+    // the diagonal of the mesh bounds. Quadric error edge collapses onto
+    // existing vertices, so the levels share the vertex buffer; vertices on a
+    // border, which includes material and UV seams, never move. The meshes
+    // are processed in parallel.
+    void buildLods(const std::vector<float>& ratios = { .5f, .25f, .125f, .0625f }, float maxError = .02f);
+
+    // Level of detail to draw mesh meshIndex with: the coarsest one whose
+    // error stays under maxPixelError pixels, when a box 'bbox' around it,
+    // such as its bounds, covers projectedSize pixels (see projectedSize in
+    // BBox.hpp). 0 is the mesh itself, i > 0 is getLodBuffer()[m_nLodOffset + i - 1].
+    unsigned int selectLod(unsigned int meshIndex, const BBox3f& bbox, float projectedSize,
+                           float maxPixelError = 1.f) const;
+
+    // Bounds of all the vertices loaded, empty until then
     const BBox3f& getBoundingBox() const {
         return m_BBox;
     }
+
+    // Parses an OBJ file without building a Geometry, for files that do not fit
+    // in memory. Triangles are handed to onChunk as they are produced, in chunks
+    // of one material whose buffers are reused once it returns; returning false
+    // stops the parse. The materials of the file are appended to 'materials'
+    // at the end, without their textures.
+    static bool streamOBJ(const FilePath& filepath, const FilePath& mtlBasePath,
+                          const std::function<bool (const MeshChunk&)>& onChunk,
+                          std::vector<Material>& materials, const StreamOptions& options = StreamOptions());
+};
+
+// Materials shared by all the geometries: loading several OBJ files that use
+// the same MTL keeps one copy of each material, found by content.
+class MaterialManager {
+private:
+    static std::unordered_multimap<size_t, std::unique_ptr<Geometry::Material>> m_MaterialMap;
+    static std::mutex m_MaterialMapMutex;
+public:
+    // Returns the shared copy of material, compared without its texture
+    // images. Thread safe.
+    static const Geometry::Material* intern(const Geometry::Material& material);
+
+    // Sets the texture images of a shared material. Thread safe.
+    static void setTextureMaps(const Geometry::Material* pMaterial, const Image* pKaMap, const Image* pKdMap,
+                               const Image* pKsMap, const Image* pNormalMap);
+};
+
+// Loads an OBJ file into a new Geometry on a background thread, so that the
+// caller can keep its event loop running. The texture images are decoded on
+// that thread too, but GL objects must still be created by the caller.
+class GeometryLoadTask {
+public:
+    GeometryLoadTask(const FilePath& filepath, const FilePath& mtlBasePath,
+                     unsigned int options = Geometry::LOAD_TEXTURES);
+
+    // Cancels the load and waits for the thread
+    ~GeometryLoadTask();
+
+    GeometryLoadTask(const GeometryLoadTask&) = delete;
+    GeometryLoadTask& operator =(const GeometryLoadTask&) = delete;
+
+    const Geometry::LoadProgress& getProgress() const {
+        return m_Progress;
+    }
+
+    void cancel() {
+        m_Progress.m_bCancelled = true;
+    }
+
+    // True once get() no longer blocks
+    bool isReady() const;
+
+    // Waits for the end of the load and hands the geometry over, null if the
+    // load failed or was cancelled. Can only be called once.
+    std::unique_ptr<Geometry> get();
+
+private:
+    Geometry::LoadProgress m_Progress;
+    std::future<std::unique_ptr<Geometry>> m_Result;
 };
 
 }
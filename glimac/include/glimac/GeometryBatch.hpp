@@ -0,0 +1,147 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include "Geometry.hpp"
+
+namespace glimac {
+
+// Static batch: the vertices and triangles of several geometries, optionally
+// transformed, merged in one vertex buffer and one index buffer so that a
+// scene of many small props is bound once and drawn with one call per
+// material. The materials stay shared through MaterialManager.
+//
+//   GeometryBatch batch;
+//   batch.add(table, tableMatrix);
+//   batch.add(chair, chairMatrix);
+//   batch.build();
+//   for each draw range: bind its material, draw its indices
+class GeometryBatch {
+public:
+    // Triangles of the batch that use a material, consecutive in the index buffer
+    struct DrawRange {
+        int m_nMaterialIndex; // In the materials of the batch, -1 if none
+        unsigned int m_nIndexOffset;
+        unsigned int m_nIndexCount;
+    };
+
+    // A geometry added to the batch
+    struct Instance {
+        glm::mat4 m_Transform;
+        unsigned int m_nVertexOffset; // Offset of its vertices in the vertex buffer
+        unsigned int m_nVertexCount;
+        unsigned int m_nMeshOffset; // Offset of its meshes in the mesh sources
+        unsigned int m_nMeshCount;
+    };
+
+    // Where a mesh of an added geometry ended up, valid after build
+    struct MeshSource {
+        unsigned int m_nInstance;
+        unsigned int m_nMesh; // Index in the mesh buffer of the geometry
+        unsigned int m_nIndexOffset; // Offset of its triangles in the index buffer
+        unsigned int m_nIndexCount;
+        int m_nMaterialIndex; // In the materials of the batch, -1 if none
+        unsigned int m_nDrawRange; // Draw range that contains them
+    };
+
+    GeometryBatch() {
+        clear();
+    }
+
+    // Appends the vertices and the meshes of geometry, with the positions,
+    // normals and tangents transformed by transform. Triangles are flipped
+    // for transforms that mirror, so that they keep facing outwards. A
+    // geometry whose vertex buffer was released is read from its packed one.
+    // Returns the index of the instance.
+    unsigned int add(const Geometry& geometry, const glm::mat4& transform = glm::mat4(1.f));
+
+    // Sorts the triangles of the index buffer by material and computes the
+    // draw ranges and the mesh sources. The meshes of a material keep the
+    // order in which they were added. Geometries can still be added after,
+    // followed by another build.
+    void build();
+
+    bool isBuilt() const {
+        return m_bBuilt;
+    }
+
+    // Removes everything
+    void clear();
+
+    const Geometry::Vertex* getVertexBuffer() const {
+        return m_VertexBuffer.data();
+    }
+
+    size_t getVertexCount() const {
+        return m_VertexBuffer.size();
+    }
+
+    // Tangent of each vertex as in Geometry::getTangentBuffer, null if no
+    // geometry added had tangents; zero for the vertices of those without
+    const glm::vec4* getTangentBuffer() const {
+        return m_TangentBuffer.empty() ? nullptr : m_TangentBuffer.data();
+    }
+
+    const unsigned int* getIndexBuffer() const {
+        return m_IndexBuffer.data();
+    }
+
+    size_t getIndexCount() const {
+        return m_IndexBuffer.size();
+    }
+
+    const DrawRange* getDrawRanges() const {
+        return m_DrawRanges.data();
+    }
+
+    size_t getDrawRangeCount() const {
+        return m_DrawRanges.size();
+    }
+
+    const Instance& getInstance(unsigned int instanceIndex) const {
+        return m_Instances[instanceIndex];
+    }
+
+    size_t getInstanceCount() const {
+        return m_Instances.size();
+    }
+
+    // Batch location of mesh meshIndex of instance instanceIndex
+    const MeshSource& getMeshSource(unsigned int instanceIndex, unsigned int meshIndex) const {
+        return m_MeshSources[m_Instances[instanceIndex].m_nMeshOffset + meshIndex];
+    }
+
+    const MeshSource* getMeshSources() const {
+        return m_MeshSources.data();
+    }
+
+    size_t getMeshSourceCount() const {
+        return m_MeshSources.size();
+    }
+
+    const Geometry::Material& getMaterial(unsigned int materialIndex) const {
+        return *m_Materials[materialIndex];
+    }
+
+    size_t getMaterialCount() const {
+        return m_Materials.size();
+    }
+
+    const BBox3f& getBoundingBox() const {
+        return m_BBox;
+    }
+
+private:
+    std::vector<Geometry::Vertex> m_VertexBuffer;
+    std::vector<glm::vec4> m_TangentBuffer; // Empty or one per vertex
+    std::vector<unsigned int> m_IndexBuffer;
+    std::vector<DrawRange> m_DrawRanges;
+    std::vector<Instance> m_Instances;
+    std::vector<MeshSource> m_MeshSources;
+    std::vector<const Geometry::Material*> m_Materials; // Shared through MaterialManager
+    std::unordered_map<const Geometry::Material*, int> m_MaterialIndices;
+    BBox3f m_BBox;
+    bool m_bBuilt;
+};
+
+}
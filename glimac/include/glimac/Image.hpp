@@ -2,6 +2,7 @@
 
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <unordered_map>
 
 #include "glm.hpp"
@@ -41,7 +42,9 @@ std::unique_ptr<Image> loadImage(const FilePath& filepath);
 class ImageManager {
 private:
     static std::unordered_map<FilePath, std::unique_ptr<Image>> m_ImageMap;
+    static std::mutex m_ImageMapMutex;
 public:
+    // Thread safe, images are decoded outside of the lock
     static const Image* loadImage(const FilePath& filepath);
 };
 
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace glimac {
+
+inline unsigned int getThreadCount() {
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Calls task(i) for each i in [0, count) on up to threadCount threads,
+// including the calling one, and returns once all calls are done. Items are
+// handed out one at a time so that uneven tasks balance themselves.
+template<typename Task>
+void parallelFor(size_t count, const Task& task, unsigned int threadCount = getThreadCount()) {
+    threadCount = unsigned(std::min<size_t>(threadCount, count));
+    if(threadCount <= 1) {
+        for(size_t i = 0; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next { 0 };
+    auto worker = [&]() {
+        for(auto i = next++; i < count; i = next++) {
+            task(i);
+        }
+    };
+    std::vector<std::thread> threads;
+    for(auto i = 1u; i < threadCount; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for(auto& thread: threads) {
+        thread.join();
+    }
+}
+
+// Calls task(begin, end) in parallel on consecutive ranges of at most
+// blockSize items covering [0, count), for loops over many small items.
+template<typename Task>
+void parallelForRange(size_t count, size_t blockSize, const Task& task) {
+    parallelFor((count + blockSize - 1) / blockSize, [&](size_t block) {
+        task(block * blockSize, std::min(count, (block + 1) * blockSize));
+    });
+}
+
+}
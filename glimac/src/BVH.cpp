@@ -0,0 +1,604 @@
+#include "glimac/BVH.hpp"
+#include "glimac/Parallel.hpp"
+#include "Lanes.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+namespace glimac {
+
+constexpr float BVH::TRAVERSAL_COST;
+constexpr float BVH::INTERSECTION_COST;
+
+namespace {
+
+const unsigned int BIN_COUNT = 16;
+
+BBox3f emptyBBox() {
+    return BBox3f(glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()));
+}
+
+// Half the surface area, enough for the ratios of the SAH
+float halfArea(const BBox3f& box) {
+    auto d = glm::max(size(box), glm::vec3(0.f));
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+// Bounds of a triangle, moved around by the build for locality
+struct TriangleRef {
+    BBox3f m_BBox;
+    unsigned int m_nTriangle;
+};
+
+// Node to build: a range of the triangle references with its bounds
+struct BuildTask {
+    unsigned int m_nNode;
+    unsigned int m_nBegin, m_nEnd;
+    BBox3f m_BBox;
+};
+
+class BVHBuilder {
+public:
+    BVHBuilder(std::vector<TriangleRef>& triangles, unsigned int maxLeafSize):
+        m_Triangles(triangles), m_nMaxLeafSize(maxLeafSize) {
+    }
+
+    // Builds the subtree of task in nodes. Subtrees of at most
+    // deferredCount triangles are left to build and added to deferred.
+    void build(std::vector<BVH::Node>& nodes, const BuildTask& task, unsigned int deferredCount,
+               std::vector<BuildTask>& deferred) const {
+        auto& node = nodes[task.m_nNode];
+        node.m_BBox = task.m_BBox;
+        auto count = task.m_nEnd - task.m_nBegin;
+        if(count <= deferredCount) {
+            deferred.push_back(task);
+            return;
+        }
+
+        BuildTask left, right;
+        if(!split(task, left, right)) {
+            node.m_nOffset = task.m_nBegin;
+            node.m_nCount = count;
+            return;
+        }
+        // nodes grows, node is no longer valid after
+        auto children = nodes.size();
+        nodes[task.m_nNode].m_nOffset = children;
+        nodes[task.m_nNode].m_nCount = 0;
+        nodes.resize(children + 2);
+        left.m_nNode = children;
+        right.m_nNode = children + 1;
+        build(nodes, left, deferredCount, deferred);
+        build(nodes, right, deferredCount, deferred);
+    }
+
+private:
+    struct Bin {
+        BBox3f m_BBox;
+        unsigned int m_nCount;
+    };
+
+    // Bin of a centroid given twice, as the lower bound and scale
+    static unsigned int getBin(float centroid2, float lower, float scale, unsigned int binCount) {
+        auto bin = int((centroid2 - lower) * scale);
+        return std::min(binCount - 1, unsigned(std::max(bin, 0)));
+    }
+
+    // Splits the triangles of task in two at the best bin boundary, or in
+    // the middle if their centroids are all the same. Returns false for a
+    // leaf.
+    bool split(const BuildTask& task, BuildTask& left, BuildTask& right) const {
+        auto count = task.m_nEnd - task.m_nBegin;
+        if(count <= 1) {
+            return false;
+        }
+
+        // Centroids given twice, as center2 gives them
+        auto centroidBBox = emptyBBox();
+        for(auto i = task.m_nBegin; i < task.m_nEnd; ++i) {
+            centroidBBox.grow(center2(m_Triangles[i].m_BBox));
+        }
+        auto extent = size(centroidBBox);
+        float bestCost = std::numeric_limits<float>::max();
+        int bestAxis = -1;
+        unsigned int bestBin = 0;
+        // All the axes in one pass over the triangles, with less bins for
+        // the small nodes where setting them up would dominate
+        auto binCount = std::min(BIN_COUNT, std::max(4u, count));
+        Bin bins[3][BIN_COUNT];
+        glm::vec3 scale;
+        for(auto axis = 0; axis < 3; ++axis) {
+            scale[axis] = extent[axis] > 0.f ? binCount / extent[axis] : 0.f;
+            for(auto b = 0u; b < binCount; ++b) {
+                bins[axis][b].m_BBox = emptyBBox();
+                bins[axis][b].m_nCount = 0;
+            }
+        }
+        for(auto i = task.m_nBegin; i < task.m_nEnd; ++i) {
+            const auto& box = m_Triangles[i].m_BBox;
+            auto centroid2 = center2(box);
+            for(auto axis = 0; axis < 3; ++axis) {
+                auto& bin = bins[axis][getBin(centroid2[axis], centroidBBox.lower[axis], scale[axis], binCount)];
+                bin.m_BBox.grow(box);
+                ++bin.m_nCount;
+            }
+        }
+
+        for(auto axis = 0; axis < 3; ++axis) {
+            if(extent[axis] <= 0.f) {
+                continue;
+            }
+
+            // Right side costs from the right, then sweep from the left
+            float rightCosts[BIN_COUNT];
+            auto box = emptyBBox();
+            auto rightCount = 0u;
+            for(auto b = binCount - 1; b > 0; --b) {
+                box.grow(bins[axis][b].m_BBox);
+                rightCount += bins[axis][b].m_nCount;
+                rightCosts[b] = rightCount ? halfArea(box) * rightCount : 0.f;
+            }
+            box = emptyBBox();
+            auto leftCount = 0u;
+            for(auto b = 1u; b < binCount; ++b) {
+                box.grow(bins[axis][b - 1].m_BBox);
+                leftCount += bins[axis][b - 1].m_nCount;
+                float cost = (leftCount ? halfArea(box) * leftCount : 0.f) + rightCosts[b];
+                if(leftCount && leftCount < count && cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        float leafCost = BVH::INTERSECTION_COST * count;
+        if(bestAxis >= 0) {
+            float area = std::max(halfArea(task.m_BBox), std::numeric_limits<float>::min());
+            float splitCost = BVH::TRAVERSAL_COST + BVH::INTERSECTION_COST * bestCost / area;
+            if(splitCost >= leafCost && count <= m_nMaxLeafSize) {
+                return false;
+            }
+        } else if(count <= m_nMaxLeafSize) {
+            return false;
+        }
+
+        left = task;
+        right = task;
+        if(bestAxis >= 0) {
+            float lower = centroidBBox.lower[bestAxis];
+            auto middle = std::partition(m_Triangles.begin() + task.m_nBegin, m_Triangles.begin() + task.m_nEnd,
+                                         [&](const TriangleRef& triangle) {
+                return getBin(center2(triangle.m_BBox)[bestAxis], lower, scale[bestAxis], binCount) < bestBin;
+            }) - m_Triangles.begin();
+            left.m_nEnd = right.m_nBegin = middle;
+            left.m_BBox = right.m_BBox = emptyBBox();
+            for(auto b = 0u; b < binCount; ++b) {
+                (b < bestBin ? left : right).m_BBox.grow(bins[bestAxis][b].m_BBox);
+            }
+        } else {
+            // Same centroids: any half will do
+            left.m_nEnd = right.m_nBegin = task.m_nBegin + count / 2;
+            for(auto side: { &left, &right }) {
+                side->m_BBox = emptyBBox();
+                for(auto i = side->m_nBegin; i < side->m_nEnd; ++i) {
+                    side->m_BBox.grow(m_Triangles[i].m_BBox);
+                }
+            }
+        }
+        return true;
+    }
+
+    std::vector<TriangleRef>& m_Triangles;
+    unsigned int m_nMaxLeafSize;
+};
+
+}
+
+void BVH::build(const Geometry& geometry, unsigned int maxLeafSize) {
+    auto start = std::chrono::steady_clock::now();
+    auto triangleCount = geometry.getIndexCount() / 3;
+    m_Nodes.clear();
+    m_TriangleIndices.clear();
+    m_QueryNodes.clear();
+    m_Triangles.clear();
+    m_TriangleMeshes.clear();
+    m_nDepth = 0;
+    if(!triangleCount) {
+        return;
+    }
+
+    auto pVertices = geometry.getVertexBuffer();
+    auto pIndices = geometry.getIndexBuffer();
+    std::vector<TriangleRef> triangles(triangleCount);
+    const size_t blockSize = 1 << 14;
+    auto blockCount = (triangleCount + blockSize - 1) / blockSize;
+    std::vector<BBox3f> blockBoxes(blockCount, emptyBBox());
+    parallelForRange(triangleCount, blockSize, [&](size_t begin, size_t end) {
+        auto& blockBox = blockBoxes[begin / blockSize];
+        for(auto t = begin; t < end; ++t) {
+            auto& box = triangles[t].m_BBox;
+            box = BBox3f(pVertices[pIndices[3 * t]].m_Position);
+            box.grow(pVertices[pIndices[3 * t + 1]].m_Position);
+            box.grow(pVertices[pIndices[3 * t + 2]].m_Position);
+            triangles[t].m_nTriangle = t;
+            blockBox.grow(box);
+        }
+    });
+
+    BuildTask root;
+    root.m_nNode = 0;
+    root.m_nBegin = 0;
+    root.m_nEnd = triangleCount;
+    root.m_BBox = emptyBBox();
+    for(const auto& box: blockBoxes) {
+        root.m_BBox.grow(box);
+    }
+
+    // Top levels down to about 8 subtrees per thread, then the subtrees
+    BVHBuilder builder(triangles, std::max(1u, maxLeafSize));
+    std::vector<BuildTask> subtrees;
+    auto subtreeSize = getThreadCount() > 1 ? unsigned(std::max<size_t>(1024, triangleCount / (8 * getThreadCount()))) : 0u;
+    m_Nodes.resize(1);
+    builder.build(m_Nodes, root, subtreeSize, subtrees);
+
+    std::vector<std::vector<Node>> subtreeNodes(subtrees.size());
+    parallelFor(subtrees.size(), [&](size_t i) {
+        std::vector<BuildTask> none;
+        auto task = subtrees[i];
+        task.m_nNode = 0;
+        subtreeNodes[i].resize(1);
+        builder.build(subtreeNodes[i], task, 0, none);
+    });
+
+    // The root of each subtree replaces its placeholder, the other nodes are
+    // appended in the same order
+    for(size_t i = 0; i < subtrees.size(); ++i) {
+        const auto& nodes = subtreeNodes[i];
+        unsigned int base = m_Nodes.size() - 1;
+        for(size_t j = 0; j < nodes.size(); ++j) {
+            auto node = nodes[j];
+            if(!node.isLeaf()) {
+                node.m_nOffset += base;
+            }
+            if(j == 0) {
+                m_Nodes[subtrees[i].m_nNode] = node;
+            } else {
+                m_Nodes.push_back(node);
+            }
+        }
+    }
+    m_TriangleIndices.resize(triangleCount);
+    for(size_t i = 0; i < triangleCount; ++i) {
+        m_TriangleIndices[i] = triangles[i].m_nTriangle;
+    }
+
+    // What the queries read, in leaf order so that a leaf is contiguous
+    std::vector<unsigned int> meshes(triangleCount, NO_HIT);
+    for(size_t i = 0; i < geometry.getMeshCount(); ++i) {
+        const auto& mesh = geometry.getMeshBuffer()[i];
+        std::fill(meshes.begin() + mesh.m_nIndexOffset / 3,
+                  meshes.begin() + (mesh.m_nIndexOffset + mesh.m_nIndexCount) / 3, unsigned(i));
+    }
+    m_Triangles.resize(triangleCount);
+    m_TriangleMeshes.resize(triangleCount);
+    parallelForRange(triangleCount, blockSize, [&](size_t begin, size_t end) {
+        for(auto i = begin; i < end; ++i) {
+            auto t = m_TriangleIndices[i];
+            const auto& p0 = pVertices[pIndices[3 * t]].m_Position;
+            m_Triangles[i].m_Vertex = p0;
+            m_Triangles[i].m_Edge1 = pVertices[pIndices[3 * t + 1]].m_Position - p0;
+            m_Triangles[i].m_Edge2 = pVertices[pIndices[3 * t + 2]].m_Position - p0;
+            m_TriangleMeshes[i] = meshes[t];
+        }
+    });
+
+    buildQueryNodes();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::clog << "Build BVH (" << triangleCount << " triangles, " << m_Nodes.size() << " nodes, SAH cost "
+              << getSAHCost() << ", " << elapsed.count() << " s, " << elapsed.count() * 1e6 / triangleCount
+              << " s per million triangles)." << std::endl;
+}
+
+float BVH::getSAHCost() const {
+    if(m_Nodes.empty()) {
+        return 0.f;
+    }
+    double cost = 0.;
+    for(const auto& node: m_Nodes) {
+        cost += halfArea(node.m_BBox) * (node.isLeaf() ? INTERSECTION_COST * node.m_nCount : TRAVERSAL_COST);
+    }
+    auto rootArea = halfArea(m_Nodes[0].m_BBox);
+    return rootArea > 0.f ? float(cost / rootArea) : float(m_Nodes.size());
+}
+
+void BVH::buildQueryNodes() {
+    // Each query node opens the binary nodes with the largest area among its
+    // children until it has 4 or only leaves
+    struct Pending {
+        unsigned int m_nQueryNode;
+        unsigned int m_nNode;
+        unsigned int m_nDepth;
+    };
+    std::vector<Pending> pending { { 0, 0, 1 } };
+    m_QueryNodes.resize(1);
+    m_nDepth = 1;
+    while(!pending.empty()) {
+        auto current = pending.back();
+        pending.pop_back();
+        unsigned int children[4] = { current.m_nNode };
+        unsigned int childCount = 1;
+        while(childCount < 4) {
+            int best = -1;
+            float bestArea = -1.f;
+            for(auto i = 0u; i < childCount; ++i) {
+                const auto& node = m_Nodes[children[i]];
+                if(!node.isLeaf() && halfArea(node.m_BBox) > bestArea) {
+                    best = i;
+                    bestArea = halfArea(node.m_BBox);
+                }
+            }
+            if(best < 0) {
+                break;
+            }
+            auto first = m_Nodes[children[best]].m_nOffset;
+            children[best] = first;
+            children[childCount++] = first + 1;
+        }
+
+        auto& queryNode = m_QueryNodes[current.m_nQueryNode];
+        queryNode.m_nChildCount = childCount;
+        for(auto i = 0u; i < 4; ++i) {
+            // Unused lanes are masked out by the traversal
+            auto box = i < childCount ? m_Nodes[children[i]].m_BBox : BBox3f(glm::vec3(0.f));
+            for(auto axis = 0; axis < 3; ++axis) {
+                queryNode.m_Lower[axis][i] = box.lower[axis];
+                queryNode.m_Upper[axis][i] = box.upper[axis];
+            }
+            queryNode.m_nChildren[i] = 0;
+            queryNode.m_nCounts[i] = 0;
+        }
+        unsigned int next = m_QueryNodes.size();
+        for(auto i = 0u; i < childCount; ++i) {
+            const auto& node = m_Nodes[children[i]];
+            if(node.isLeaf()) {
+                queryNode.m_nChildren[i] = node.m_nOffset;
+                queryNode.m_nCounts[i] = node.m_nCount;
+            } else {
+                queryNode.m_nChildren[i] = next;
+                pending.push_back({ next++, children[i], current.m_nDepth + 1 });
+                m_nDepth = std::max(m_nDepth, current.m_nDepth + 1);
+            }
+        }
+        // queryNode is no longer valid after
+        m_QueryNodes.resize(next);
+    }
+}
+
+// Rays of the packet in the lanes of Float. The closest hit so far bounds
+// the slab and triangle tests; the rays of any-hit queries that found one get
+// -infinity, which fails both. A single ray tests the 4 children of a query
+// node at once, a packet tests each child for all its rays at once.
+template<typename Float, bool ANY_HIT>
+void BVH::traverse(const Ray* pRays, Hit* pHits, bool* pOccluded) const {
+    const unsigned int N = Float::SIZE;
+    const float infinity = std::numeric_limits<float>::infinity();
+    float values[3][3][N], tMin[N], tMax[N];
+    for(auto i = 0u; i < N; ++i) {
+        for(auto axis = 0; axis < 3; ++axis) {
+            float d = pRays[i].m_Direction[axis];
+            values[0][axis][i] = pRays[i].m_Origin[axis];
+            values[1][axis][i] = d;
+            // Zero would give 0 * infinity in the slab test
+            values[2][axis][i] = 1.f / (std::abs(d) > 1e-20f ? d : std::copysign(1e-20f, d));
+        }
+        tMin[i] = pRays[i].m_TMin;
+        tMax[i] = pRays[i].m_TMax;
+    }
+    Float origin[3], direction[3], invDirection[3];
+    Lanes4 rayOrigin[3], rayInvDirection[3];
+    for(auto axis = 0; axis < 3; ++axis) {
+        origin[axis] = Float::load(values[0][axis]);
+        direction[axis] = Float::load(values[1][axis]);
+        invDirection[axis] = Float::load(values[2][axis]);
+        rayOrigin[axis] = Lanes4(values[0][axis][0]);
+        rayInvDirection[axis] = Lanes4(values[2][axis][0]);
+    }
+    auto rayTMin = Float::load(tMin);
+    auto distance = Float::load(tMax);
+    Float u(0.f), v(0.f);
+    unsigned int hitPositions[N];
+    std::fill(hitPositions, hitPositions + N, NO_HIT);
+    const unsigned int allLanes = (1u << N) - 1;
+    unsigned int occludedLanes = 0;
+
+    auto farthest = [&]() {
+        float distances[N];
+        distance.store(distances);
+        return *std::max_element(distances, distances + N);
+    };
+    // Lanes whose ray crosses child c of node, and where the first one enters it
+    auto slab = [&](const QueryNode& node, unsigned int c, float& nearest) {
+        auto entry = rayTMin, exit = distance;
+        for(auto axis = 0; axis < 3; ++axis) {
+            auto t0 = (Float(node.m_Lower[axis][c]) - origin[axis]) * invDirection[axis];
+            auto t1 = (Float(node.m_Upper[axis][c]) - origin[axis]) * invDirection[axis];
+            entry = max(entry, min(t0, t1));
+            exit = min(exit, max(t0, t1));
+        }
+        auto crossed = entry <= exit;
+        auto lanes = getMask(crossed);
+        if(lanes) {
+            float entries[N];
+            select(crossed, entry, Float(infinity)).store(entries);
+            nearest = *std::min_element(entries, entries + N);
+        }
+        return lanes;
+    };
+    // Children of node crossed by a single ray, one bit each, and where it
+    // enters them
+    auto slab4 = [&](const QueryNode& node, float* entries) {
+        auto entry = Lanes4(tMin[0]), exit = Lanes4(farthest());
+        for(auto axis = 0; axis < 3; ++axis) {
+            auto t0 = (Lanes4::load(node.m_Lower[axis]) - rayOrigin[axis]) * rayInvDirection[axis];
+            auto t1 = (Lanes4::load(node.m_Upper[axis]) - rayOrigin[axis]) * rayInvDirection[axis];
+            entry = max(entry, min(t0, t1));
+            exit = min(exit, max(t0, t1));
+        }
+        entry.store(entries);
+        return getMask(entry <= exit) & ((1u << node.m_nChildCount) - 1);
+    };
+    // Moller-Trumbore, a null determinant gives infinities or NaNs that fail
+    // the comparisons
+    auto intersectTriangle = [&](unsigned int position) {
+        const auto& triangle = m_Triangles[position];
+        Float edge1[3], edge2[3], s[3], p[3], q[3];
+        for(auto axis = 0; axis < 3; ++axis) {
+            edge1[axis] = Float(triangle.m_Edge1[axis]);
+            edge2[axis] = Float(triangle.m_Edge2[axis]);
+            s[axis] = origin[axis] - Float(triangle.m_Vertex[axis]);
+        }
+        cross(direction, edge2, p);
+        auto invDeterminant = Float(1.f) / dot(edge1, p);
+        auto hitU = dot(s, p) * invDeterminant;
+        cross(s, edge1, q);
+        auto hitV = dot(direction, q) * invDeterminant;
+        auto t = dot(edge2, q) * invDeterminant;
+        auto hitMask = (Float(0.f) <= hitU) & (Float(0.f) <= hitV) & (hitU + hitV <= Float(1.f)) &
+                       (rayTMin <= t) & (t < distance);
+        auto lanes = getMask(hitMask);
+        if(!lanes) {
+            return;
+        }
+        if(ANY_HIT) {
+            distance = select(hitMask, Float(-infinity), distance);
+            occludedLanes |= lanes;
+            return;
+        }
+        distance = select(hitMask, t, distance);
+        u = select(hitMask, hitU, u);
+        v = select(hitMask, hitV, v);
+        for(auto i = 0u; i < N; ++i) {
+            if(lanes & (1u << i)) {
+                hitPositions[i] = position;
+            }
+        }
+    };
+
+    // Children wait on the stack with where the packet enters them, the
+    // nearest on top
+    struct StackEntry {
+        unsigned int m_nChild;
+        unsigned int m_nCount;
+        float m_Entry;
+    };
+    StackEntry localStack[128];
+    std::vector<StackEntry> heapStack;
+    auto pStack = localStack;
+    if(3 * m_nDepth + 1 > 128) {
+        heapStack.resize(3 * m_nDepth + 1);
+        pStack = heapStack.data();
+    }
+    unsigned int stackSize = 0;
+    if(!m_QueryNodes.empty()) {
+        pStack[stackSize++] = { 0, 0, -infinity };
+    }
+
+    while(stackSize) {
+        auto current = pStack[--stackSize];
+        if(current.m_Entry > farthest()) {
+            continue;
+        }
+        if(current.m_nCount) {
+            for(auto i = current.m_nChild; i < current.m_nChild + current.m_nCount; ++i) {
+                intersectTriangle(i);
+            }
+            if(ANY_HIT && occludedLanes == allLanes) {
+                break;
+            }
+            continue;
+        }
+
+        const auto& node = m_QueryNodes[current.m_nChild];
+        float entries[4];
+        unsigned int children = 0;
+        if(N == 1) {
+            children = slab4(node, entries);
+        } else {
+            for(auto c = 0u; c < node.m_nChildCount; ++c) {
+                if(slab(node, c, entries[c])) {
+                    children |= 1u << c;
+                }
+            }
+        }
+        // Pushed from the farthest so that the nearest is popped first
+        auto first = stackSize;
+        for(auto c = 0u; c < 4; ++c) {
+            if(!(children & (1u << c))) {
+                continue;
+            }
+            StackEntry entry = { node.m_nChildren[c], node.m_nCounts[c], entries[c] };
+            auto i = stackSize++;
+            for(; i > first && pStack[i - 1].m_Entry < entry.m_Entry; --i) {
+                pStack[i] = pStack[i - 1];
+            }
+            pStack[i] = entry;
+        }
+    }
+
+    if(ANY_HIT) {
+        for(auto i = 0u; i < N; ++i) {
+            pOccluded[i] = (occludedLanes >> i) & 1;
+        }
+        return;
+    }
+    float distances[N], us[N], vs[N];
+    distance.store(distances);
+    u.store(us);
+    v.store(vs);
+    for(auto i = 0u; i < N; ++i) {
+        auto& hit = pHits[i];
+        hit.m_Distance = distances[i];
+        hit.m_Barycentrics = glm::vec2(us[i], vs[i]);
+        if(hitPositions[i] == NO_HIT) {
+            hit.m_nTriangle = hit.m_nMesh = NO_HIT;
+        } else {
+            hit.m_nTriangle = m_TriangleIndices[hitPositions[i]];
+            hit.m_nMesh = m_TriangleMeshes[hitPositions[i]];
+        }
+    }
+}
+
+bool BVH::intersect(const Ray& ray, Hit& hit) const {
+    traverse<Lanes1, false>(&ray, &hit, nullptr);
+    return hit.isHit();
+}
+
+bool BVH::occluded(const Ray& ray) const {
+    bool result;
+    traverse<Lanes1, true>(&ray, nullptr, &result);
+    return result;
+}
+
+void BVH::intersect4(const Ray* pRays, Hit* pHits) const {
+    traverse<Lanes4, false>(pRays, pHits, nullptr);
+}
+
+void BVH::intersect8(const Ray* pRays, Hit* pHits) const {
+    traverse<Lanes8, false>(pRays, pHits, nullptr);
+}
+
+void BVH::occluded4(const Ray* pRays, bool* pOccluded) const {
+    traverse<Lanes4, true>(pRays, nullptr, pOccluded);
+}
+
+void BVH::occluded8(const Ray* pRays, bool* pOccluded) const {
+    traverse<Lanes8, true>(pRays, nullptr, pOccluded);
+}
+
+}
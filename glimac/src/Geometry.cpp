@@ -1,173 +1,2906 @@
 #include "glimac/Geometry.hpp"
+#include "glimac/Parallel.hpp"
+#include "Lanes.hpp"
 #include "tiny_obj_loader.h"
+#include <glm/gtc/packing.hpp>
 #include <iostream>
+#include <fstream>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <sys/stat.h>
 
 namespace glimac {
 
-void Geometry::generateNormals(unsigned int meshIndex) {
-    auto indexOffset = m_MeshBuffer[meshIndex].m_nIndexOffset;
-    for (auto j = 0u; j < m_MeshBuffer[meshIndex].m_nIndexCount; j += 3) {
-        auto i1 = m_IndexBuffer[indexOffset + j];
-        auto i2 = m_IndexBuffer[indexOffset + j + 1];
-        auto i3 = m_IndexBuffer[indexOffset + j + 2];
+namespace {
 
-        auto n = glm::cross(glm::normalize(m_VertexBuffer[i2].m_Position - m_VertexBuffer[i1].m_Position),
-                            glm::normalize(m_VertexBuffer[i3].m_Position - m_VertexBuffer[i1].m_Position));
+// Smallest and largest index of a mesh, whose vertices are contiguous
+void getIndexRange(const unsigned int* pIndices, size_t indexCount, unsigned int& first, unsigned int& last) {
+    first = indexCount ? pIndices[0] : 0;
+    last = first;
+    for(size_t i = 1; i < indexCount; ++i) {
+        first = std::min(first, pIndices[i]);
+        last = std::max(last, pIndices[i]);
+    }
+}
+
+const auto NO_VERTEX_GROUP = ~0u;
+
+struct VertexGroup {
+    unsigned int m_nFirst, m_nLast;
+};
+
+// Groups the meshes from meshOffset on whose vertex ranges overlap, which
+// are the meshes of a shape. Returns the vertex range of each group, by
+// increasing first vertex, and sets the group of each mesh in meshGroups,
+// NO_VERTEX_GROUP for the empty ones and the ones before meshOffset.
+std::vector<VertexGroup> groupMeshVertices(const std::vector<Geometry::Mesh>& meshes, size_t meshOffset,
+                                           const std::vector<unsigned int>& indices,
+                                           std::vector<unsigned int>& meshGroups) {
+    struct Range {
+        unsigned int m_nFirst, m_nLast, m_nMesh;
+    };
+    std::vector<Range> ranges;
+    for(auto i = meshOffset; i < meshes.size(); ++i) {
+        const auto& mesh = meshes[i];
+        if(mesh.m_nIndexCount) {
+            Range range;
+            getIndexRange(indices.data() + mesh.m_nIndexOffset, mesh.m_nIndexCount, range.m_nFirst, range.m_nLast);
+            range.m_nMesh = i;
+            ranges.push_back(range);
+        }
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) {
+        return a.m_nFirst < b.m_nFirst;
+    });
+
+    std::vector<VertexGroup> groups;
+    meshGroups.assign(meshes.size(), NO_VERTEX_GROUP);
+    for(size_t i = 0, j; i < ranges.size(); i = j) {
+        VertexGroup group = { ranges[i].m_nFirst, ranges[i].m_nLast };
+        for(j = i + 1; j < ranges.size() && ranges[j].m_nFirst <= group.m_nLast; ++j) {
+            group.m_nLast = std::max(group.m_nLast, ranges[j].m_nLast);
+        }
+        for(auto k = i; k < j; ++k) {
+            meshGroups[ranges[k].m_nMesh] = groups.size();
+        }
+        groups.push_back(group);
+    }
+    return groups;
+}
+
+glm::vec3 normalizeOrZero(const glm::vec3& v) {
+    float length = glm::length(v);
+    return length > 0.f ? v / length : glm::vec3(0.f);
+}
+
+// acos within 7e-5 radians (Abramowitz and Stegun 4.4.45), plenty for weights
+float fastAcos(float x) {
+    float a = std::abs(x);
+    float r = std::sqrt(1.f - a) * (1.5707288f + a * (-0.2121144f + a * (0.0742610f - 0.0187293f * a)));
+    return x < 0.f ? glm::pi<float>() - r : r;
+}
+
+template<typename Float>
+Float fastAcos(const Float& x) {
+    auto a = max(x, Float(0.f) - x);
+    auto r = sqrt(Float(1.f) - a) *
+             (Float(1.5707288f) + a * (Float(-0.2121144f) + a * (Float(0.0742610f) - Float(0.0187293f) * a)));
+    return select(x < Float(0.f), Float(glm::pi<float>()) - r, r);
+}
+
+// Local vertices of the same position get the same id: the first of them
+void weldPositions(const Geometry::Vertex* pVertices, size_t vertexCount, std::vector<unsigned int>& welded) {
+    size_t tableSize = 1;
+    while(tableSize < 2 * vertexCount) {
+        tableSize *= 2;
+    }
+    const auto empty = ~0u;
+    std::vector<unsigned int> table(tableSize, empty);
+    welded.resize(vertexCount);
+    for(size_t v = 0; v < vertexCount; ++v) {
+        const auto& p = pVertices[v].m_Position;
+        uint32_t bits[3];
+        std::memcpy(bits, &p, sizeof(bits));
+        size_t slot = (bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u) & (tableSize - 1);
+        while(table[slot] != empty && std::memcmp(&pVertices[table[slot]].m_Position, &p, sizeof(p)) != 0) {
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        if(table[slot] == empty) {
+            table[slot] = v;
+        }
+        welded[v] = table[slot];
+    }
+}
+
+// Corners of each of vertexCount vertices in compressed rows: the corners c
+// with vertexOf(c) == v are corners[offsets[v], offsets[v + 1]), in order
+template<typename VertexOf>
+void buildCornerAdjacency(size_t cornerCount, size_t vertexCount, const VertexOf& vertexOf,
+                          std::vector<unsigned int>& offsets, std::vector<unsigned int>& corners) {
+    offsets.assign(vertexCount + 1, 0);
+    for(size_t c = 0; c < cornerCount; ++c) {
+        ++offsets[vertexOf(c) + 1];
+    }
+    for(size_t v = 0; v < vertexCount; ++v) {
+        offsets[v + 1] += offsets[v];
+    }
+    corners.resize(cornerCount);
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for(size_t c = 0; c < cornerCount; ++c) {
+        corners[fill[vertexOf(c)]++] = c;
+    }
+}
+
+// Angle of corner k of a triangle given its edges, edge k going from corner k to the next
+float getCornerAngle(const glm::vec3* edges, const float* lengths, unsigned int k) {
+    auto previous = (k + 2) % 3;
+    float product = lengths[k] * lengths[previous];
+    return product > 0.f ? fastAcos(glm::clamp(-glm::dot(edges[k], edges[previous]) / product, -1.f, 1.f)) : 0.f;
+}
+
+// Area and angle weighted normals of the vertices used by the triangles of
+// indices[indexOffset, indexOffset + indexCount). Vertices at the same
+// position are smoothed together so that UV seams don't show. Where faces
+// around a vertex meet at more than creaseAngle, the vertex is split: the
+// copies are appended to vertices, the vertex each was copied from to
+// pCopySources if not null, and the indices rewritten.
+// Each pass writes its own slots, so the threads never share an output.
+void computeSmoothNormals(std::vector<Geometry::Vertex>& vertices, std::vector<unsigned int>& indices,
+                          size_t indexOffset, size_t indexCount, float creaseAngle,
+                          std::vector<unsigned int>* pCopySources = nullptr) {
+    const size_t blockSize = 4096;
+    auto pIndices = indices.data() + indexOffset;
+    auto cornerCount = indexCount - indexCount % 3;
+    if(!cornerCount) {
+        return;
+    }
+    unsigned int first, last;
+    getIndexRange(pIndices, cornerCount, first, last);
+    size_t vertexCount = last - first + 1;
+
+    std::vector<unsigned int> welded;
+    weldPositions(vertices.data() + first, vertexCount, welded);
+
+    std::vector<unsigned int> cornerOffsets, corners;
+    buildCornerAdjacency(cornerCount, vertexCount, [&](size_t c) {
+        return welded[pIndices[c] - first];
+    }, cornerOffsets, corners);
+
+    // Slot of each corner in the adjacency. The face pass writes there, so
+    // that the corners around a vertex are read as contiguous lanes.
+    typedef Lanes4 Float;
+    const auto N = Float::SIZE;
+    std::vector<unsigned int> cornerSlots(cornerCount);
+    parallelForRange(cornerCount, blockSize, [&](size_t begin, size_t end) {
+        for(auto s = begin; s < end; ++s) {
+            cornerSlots[corners[s]] = s;
+        }
+    });
+
+    // Unit face normal and contribution of each corner, the face normal
+    // scaled by twice the area and by the angle of the corner, by slot and
+    // by axis. The padding keeps the last lanes in the arrays.
+    std::vector<float> slotNormals[3], slotWeights[3];
+    for(auto a = 0u; a < 3; ++a) {
+        slotNormals[a].resize(cornerCount + N, 0.f);
+        slotWeights[a].resize(cornerCount + N, 0.f);
+    }
+    auto triangleCount = cornerCount / 3;
+    parallelForRange(triangleCount, blockSize, [&](size_t begin, size_t end) {
+        for(auto t0 = begin; t0 < end; t0 += N) {
+            // Corner k of N triangles, the last one repeated past the end
+            float positions[3][3][N];
+            for(auto i = 0u; i < N; ++i) {
+                auto t = std::min<size_t>(t0 + i, end - 1);
+                for(auto k = 0u; k < 3; ++k) {
+                    const auto& p = vertices[pIndices[3 * t + k]].m_Position;
+                    for(auto a = 0u; a < 3; ++a) {
+                        positions[k][a][i] = p[a];
+                    }
+                }
+            }
+            // Edge k goes from corner k to the next one
+            Float edges[3][3], lengths[3];
+            for(auto k = 0u; k < 3; ++k) {
+                for(auto a = 0u; a < 3; ++a) {
+                    edges[k][a] = Float::load(positions[(k + 1) % 3][a]) - Float::load(positions[k][a]);
+                }
+                lengths[k] = sqrt(dot(edges[k], edges[k]));
+            }
+            Float n[3];
+            cross(edges[2], edges[0], n);
+            auto area = sqrt(dot(n, n));
+            auto inverseArea = select(Float(0.f) < area, Float(1.f) / area, Float(0.f));
+            float normals[3][N], weights[3][3][N];
+            for(auto a = 0u; a < 3; ++a) {
+                (n[a] * inverseArea).store(normals[a]);
+            }
+            for(auto k = 0u; k < 3; ++k) {
+                auto previous = (k + 2) % 3;
+                auto product = lengths[k] * lengths[previous];
+                auto cosAngle = min(max(Float(0.f) - dot(edges[k], edges[previous]) / product, Float(-1.f)), Float(1.f));
+                auto angle = select(Float(0.f) < product, fastAcos(cosAngle), Float(0.f));
+                for(auto a = 0u; a < 3; ++a) {
+                    (n[a] * angle).store(weights[k][a]);
+                }
+            }
+            for(auto i = 0u; i < N && t0 + i < end; ++i) {
+                for(auto k = 0u; k < 3; ++k) {
+                    auto s = cornerSlots[3 * (t0 + i) + k];
+                    for(auto a = 0u; a < 3; ++a) {
+                        slotNormals[a][s] = normals[a][i];
+                        slotWeights[a][s] = weights[k][a][i];
+                    }
+                }
+            }
+        }
+    });
+
+    // Normal of each corner, from the faces around it within the crease
+    // angle, N slots at a time with the slots past the vertex masked out
+    bool creases = creaseAngle < glm::pi<float>();
+    float cosCrease = std::cos(creaseAngle), cosHalfCrease = std::cos(.5f * creaseAngle);
+    std::vector<glm::vec3> cornerNormals(cornerCount);
+    parallelForRange(vertexCount, blockSize, [&](size_t begin, size_t end) {
+        static const float laneIndices[] = { 0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f };
+        static_assert(sizeof(laneIndices) / sizeof(float) >= N, "a lane index per lane");
+        auto lanes = Float::load(laneIndices);
+        auto loadSlots = [&](const std::vector<float>* pArrays, size_t s, Float* values) {
+            for(auto a = 0u; a < 3; ++a) {
+                values[a] = Float::load(pArrays[a].data() + s);
+            }
+        };
+        for(auto v = begin; v < end; ++v) {
+            auto sBegin = cornerOffsets[v], sEnd = cornerOffsets[v + 1];
+            auto inVertex = [&](size_t s) {
+                return lanes < Float(float(sEnd - s));
+            };
+            Float sum[3] = { Float(0.f), Float(0.f), Float(0.f) };
+            for(auto s = sBegin; s < sEnd; s += N) {
+                Float weights[3];
+                loadSlots(slotWeights, s, weights);
+                auto mask = inVertex(s);
+                for(auto a = 0u; a < 3; ++a) {
+                    sum[a] = sum[a] + (weights[a] & mask);
+                }
+            }
+            auto smooth = normalizeOrZero(glm::vec3(sumLanes(sum[0]), sumLanes(sum[1]), sumLanes(sum[2])));
+            Float smoothLanes[3] = { Float(smooth.x), Float(smooth.y), Float(smooth.z) };
+            // Faces within half the crease angle of the mean are all within it of each other
+            bool smoothAll = !creases;
+            for(auto s = sBegin; !smoothAll && s < sEnd; s += N) {
+                Float normals[3];
+                loadSlots(slotNormals, s, normals);
+                if(getMask((dot(normals, smoothLanes) < Float(cosHalfCrease)) & inVertex(s))) {
+                    break;
+                }
+                smoothAll = s + N >= sEnd;
+            }
+            for(auto s = sBegin; s < sEnd; ++s) {
+                auto c = corners[s];
+                cornerNormals[c] = smooth;
+                if(smoothAll) {
+                    continue;
+                }
+                Float faceNormal[3] = { Float(slotNormals[0][s]), Float(slotNormals[1][s]), Float(slotNormals[2][s]) };
+                Float creaseSum[3] = { Float(0.f), Float(0.f), Float(0.f) };
+                for(auto d = sBegin; d < sEnd; d += N) {
+                    Float normals[3], weights[3];
+                    loadSlots(slotNormals, d, normals);
+                    loadSlots(slotWeights, d, weights);
+                    auto mask = (Float(cosCrease) <= dot(faceNormal, normals)) & inVertex(d);
+                    for(auto a = 0u; a < 3; ++a) {
+                        creaseSum[a] = creaseSum[a] + (weights[a] & mask);
+                    }
+                }
+                glm::vec3 crease(sumLanes(creaseSum[0]), sumLanes(creaseSum[1]), sumLanes(creaseSum[2]));
+                // Degenerate faces take the smooth normal
+                if(glm::length(crease) > 0.f) {
+                    cornerNormals[c] = glm::normalize(crease);
+                }
+            }
+        }
+    });
+
+    // One vertex per distinct corner normal, the copies of a vertex chained
+    // through next (indexed by vertex - first, then by copy)
+    const auto none = ~0u;
+    auto copyOffset = vertices.size();
+    std::vector<unsigned int> next(vertexCount, none);
+    std::vector<bool> assigned(vertexCount, false);
+    auto sameNormal = [](const glm::vec3& a, const glm::vec3& b) {
+        return std::memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+    };
+    for(size_t c = 0; c < cornerCount; ++c) {
+        auto v = pIndices[c];
+        if(!assigned[v - first]) {
+            assigned[v - first] = true;
+            vertices[v].m_Normal = cornerNormals[c];
+            continue;
+        }
+        auto copy = v;
+        while(!sameNormal(vertices[copy].m_Normal, cornerNormals[c])) {
+            auto nextIndex = copy < copyOffset ? copy - first : vertexCount + copy - copyOffset;
+            if(next[nextIndex] == none) {
+                next[nextIndex] = vertices.size();
+                auto vertex = vertices[v];
+                vertex.m_Normal = cornerNormals[c];
+                vertices.push_back(vertex);
+                next.push_back(none);
+                if(pCopySources) {
+                    pCopySources->push_back(v);
+                }
+            }
+            copy = next[nextIndex];
+        }
+        pIndices[c] = copy;
+    }
+}
+
+}
+
+constexpr float Geometry::DEFAULT_CREASE_ANGLE;
+constexpr float Geometry::DEFAULT_WELD_POSITION_TOLERANCE;
+constexpr float Geometry::DEFAULT_WELD_NORMAL_ANGLE;
+constexpr float Geometry::DEFAULT_WELD_TEXCOORDS_TOLERANCE;
+
+namespace {
+
+// Reorders a vertex stream of vertexCount elements, or of the vertexCount
+// - copySources.size() first ones, which the copies then take theirs from
+template<typename T>
+void permuteVertexStream(std::vector<T>& stream, size_t vertexCount, const std::vector<unsigned int>& newIndices,
+                         const std::vector<unsigned int>& copySources) {
+    auto copyOffset = vertexCount - copySources.size();
+    if(stream.size() != vertexCount && stream.size() != copyOffset) {
+        return;
+    }
+    std::vector<T> permuted(vertexCount);
+    for(size_t v = 0; v < vertexCount; ++v) {
+        permuted[newIndices[v]] = stream[v < stream.size() ? v : copySources[v - copyOffset]];
+    }
+    stream.swap(permuted);
+}
+
+// New index of each vertex once the copies appended from copyOffset go
+// right after the vertices of the group of their source, so that meshes keep
+// a contiguous range. The copies of vertices of no group go last.
+std::vector<unsigned int> placeVertexCopies(const std::vector<VertexGroup>& groups, size_t copyOffset,
+                                            const std::vector<unsigned int>& copySources) {
+    std::vector<unsigned int> copyGroups(copySources.size(), NO_VERTEX_GROUP);
+    std::vector<unsigned int> groupOffsets(groups.size() + 1, 0);
+    for(size_t c = 0; c < copySources.size(); ++c) {
+        auto it = std::upper_bound(groups.begin(), groups.end(), copySources[c], [](unsigned int v, const VertexGroup& group) {
+            return v < group.m_nFirst;
+        });
+        if(it != groups.begin() && copySources[c] <= (it - 1)->m_nLast) {
+            copyGroups[c] = it - 1 - groups.begin();
+            ++groupOffsets[copyGroups[c] + 1];
+        }
+    }
+    for(size_t g = 0; g < groups.size(); ++g) {
+        groupOffsets[g + 1] += groupOffsets[g];
+    }
+    std::vector<unsigned int> groupCopies(groupOffsets.back());
+    {
+        auto fill = groupOffsets;
+        for(size_t c = 0; c < copySources.size(); ++c) {
+            if(copyGroups[c] != NO_VERTEX_GROUP) {
+                groupCopies[fill[copyGroups[c]]++] = c;
+            }
+        }
+    }
+    std::vector<unsigned int> newIndices(copyOffset + copySources.size());
+    unsigned int next = 0;
+    size_t g = 0;
+    for(size_t v = 0; v < copyOffset; ++v) {
+        newIndices[v] = next++;
+        if(g < groups.size() && groups[g].m_nLast == v) {
+            for(auto i = groupOffsets[g]; i < groupOffsets[g + 1]; ++i) {
+                newIndices[copyOffset + groupCopies[i]] = next++;
+            }
+            ++g;
+        }
+    }
+    for(size_t c = 0; c < copySources.size(); ++c) {
+        if(copyGroups[c] == NO_VERTEX_GROUP) {
+            newIndices[copyOffset + c] = next++;
+        }
+    }
+    return newIndices;
+}
+
+}
+
+void Geometry::insertVertexCopies(const std::vector<unsigned int>& newIndices,
+                                  const std::vector<unsigned int>& copySources) {
+    auto remap = [&](std::vector<unsigned int>& indices) {
+        parallelForRange(indices.size(), 1 << 16, [&](size_t begin, size_t end) {
+            for(auto i = begin; i < end; ++i) {
+                indices[i] = newIndices[indices[i]];
+            }
+        });
+    };
+    remap(m_IndexBuffer);
+    remap(m_MeshletVertexBuffer);
+    remap(m_LodIndexBuffer);
+    permuteVertexStream(m_VertexBuffer, m_VertexBuffer.size(), newIndices, copySources);
+    permuteVertexStream(m_PositionBuffer, m_VertexBuffer.size(), newIndices, copySources);
+    permuteVertexStream(m_TangentBuffer, m_VertexBuffer.size(), newIndices, copySources);
+    permuteVertexStream(m_PackedVertexBuffer, m_VertexBuffer.size(), newIndices, copySources);
+    if(!m_ShortIndexBuffer.empty()) {
+        narrowIndices();
+    }
+}
+
+void Geometry::generateNormals(size_t indexOffset, size_t indexCount, float creaseAngle) {
+    std::vector<unsigned int> meshGroups, copySources;
+    auto groups = groupMeshVertices(m_MeshBuffer, 0, m_IndexBuffer, meshGroups);
+    auto copyOffset = m_VertexBuffer.size();
+    computeSmoothNormals(m_VertexBuffer, m_IndexBuffer, indexOffset, indexCount, creaseAngle, &copySources);
+    if(!copySources.empty()) {
+        // The vertices split at creases stay in the range of their shape
+        insertVertexCopies(placeVertexCopies(groups, copyOffset, copySources), copySources);
+    }
+}
+
+void Geometry::buildPositionBuffer(size_t vertexOffset) {
+    vertexOffset = std::min(vertexOffset, m_PositionBuffer.size());
+    m_PositionBuffer.resize(m_VertexBuffer.size());
+    parallelForRange(m_VertexBuffer.size() - vertexOffset, 1 << 16, [&](size_t begin, size_t end) {
+        for(auto i = vertexOffset + begin; i < vertexOffset + end; ++i) {
+            m_PositionBuffer[i] = m_VertexBuffer[i].m_Position;
+        }
+    });
+}
+
+void Geometry::generateTangents(size_t indexOffset, size_t indexCount) {
+    const size_t blockSize = 4096;
+    auto pIndices = m_IndexBuffer.data() + indexOffset;
+    auto cornerCount = indexCount - indexCount % 3;
+    if(!cornerCount) {
+        m_TangentBuffer.resize(m_VertexBuffer.size(), glm::vec4(0.f));
+        return;
+    }
+    unsigned int first, last;
+    getIndexRange(pIndices, cornerCount, first, last);
+
+    // The sign of the UV area flips the frame of mirrored faces
+    auto isMirrored = [&](size_t t) {
+        const auto& t0 = m_VertexBuffer[pIndices[3 * t]].m_TexCoords;
+        auto d1 = m_VertexBuffer[pIndices[3 * t + 1]].m_TexCoords - t0;
+        auto d2 = m_VertexBuffer[pIndices[3 * t + 2]].m_TexCoords - t0;
+        return d1.x * d2.y - d2.x * d1.y < 0.f;
+    };
+
+    // As in MikkTSpace, a vertex shared by mirrored faces and other faces is
+    // split, the mirrored ones taking a copy, so that each side gets its
+    // own frame. sides has bit 0 set for the vertices of unmirrored faces
+    // and bit 1 for those of mirrored ones.
+    std::vector<bool> mirrored(cornerCount / 3);
+    std::vector<unsigned char> sides(last - first + 1, 0);
+    bool split = false;
+    for(size_t t = 0; t < cornerCount / 3; ++t) {
+        mirrored[t] = isMirrored(t);
+        for(auto k = 0u; k < 3; ++k) {
+            auto& side = sides[pIndices[3 * t + k] - first];
+            side |= mirrored[t] ? 2 : 1;
+            split = split || side == 3;
+        }
+    }
+    if(split) {
+        std::vector<unsigned int> meshGroups, copySources;
+        auto groups = groupMeshVertices(m_MeshBuffer, 0, m_IndexBuffer, meshGroups);
+        auto copyOffset = m_VertexBuffer.size();
+        const auto none = ~0u;
+        std::vector<unsigned int> copies(last - first + 1, none);
+        for(size_t c = 0; c < cornerCount; ++c) {
+            auto v = pIndices[c] - first;
+            if(mirrored[c / 3] && sides[v] == 3) {
+                if(copies[v] == none) {
+                    copies[v] = copyOffset + copySources.size();
+                    copySources.push_back(pIndices[c]);
+                }
+                pIndices[c] = copies[v];
+            }
+        }
+        m_VertexBuffer.resize(copyOffset + copySources.size());
+        for(size_t c = 0; c < copySources.size(); ++c) {
+            m_VertexBuffer[copyOffset + c] = m_VertexBuffer[copySources[c]];
+        }
+        insertVertexCopies(placeVertexCopies(groups, copyOffset, copySources), copySources);
+        getIndexRange(pIndices, cornerCount, first, last);
+    }
+    m_TangentBuffer.resize(m_VertexBuffer.size(), glm::vec4(0.f));
+
+    std::vector<unsigned int> cornerOffsets, corners;
+    buildCornerAdjacency(cornerCount, last - first + 1, [&](size_t c) {
+        return pIndices[c] - first;
+    }, cornerOffsets, corners);
+
+    // Unit tangent and bitangent of each face from its texture coordinates,
+    // weighted by the angle of each corner as MikkTSpace does
+    std::vector<glm::vec3> cornerTangents(cornerCount), cornerBitangents(cornerCount);
+    parallelForRange(cornerCount / 3, blockSize, [&](size_t begin, size_t end) {
+        for(auto t = begin; t < end; ++t) {
+            const Vertex* v[3];
+            for(auto k = 0u; k < 3; ++k) {
+                v[k] = &m_VertexBuffer[pIndices[3 * t + k]];
+            }
+            glm::vec3 edges[3] = {
+                v[1]->m_Position - v[0]->m_Position, v[2]->m_Position - v[1]->m_Position,
+                v[0]->m_Position - v[2]->m_Position
+            };
+            float lengths[3] = { glm::length(edges[0]), glm::length(edges[1]), glm::length(edges[2]) };
+            auto e1 = edges[0], e2 = -edges[2];
+            auto d1 = v[1]->m_TexCoords - v[0]->m_TexCoords, d2 = v[2]->m_TexCoords - v[0]->m_TexCoords;
+            float sign = mirrored[t] ? -1.f : 1.f;
+            auto tangent = normalizeOrZero(sign * (e1 * d2.y - e2 * d1.y));
+            auto bitangent = normalizeOrZero(sign * (e2 * d1.x - e1 * d2.x));
+            for(auto k = 0u; k < 3; ++k) {
+                float angle = getCornerAngle(edges, lengths, k);
+                cornerTangents[3 * t + k] = tangent * angle;
+                cornerBitangents[3 * t + k] = bitangent * angle;
+            }
+        }
+    });
+
+    // Orthonormalized against the vertex normal, bitangent sign in w
+    parallelForRange(last - first + 1, blockSize, [&](size_t begin, size_t end) {
+        for(auto v = begin; v < end; ++v) {
+            if(cornerOffsets[v] == cornerOffsets[v + 1]) {
+                continue;
+            }
+            glm::vec3 tangent(0.f), bitangent(0.f);
+            for(auto j = cornerOffsets[v]; j < cornerOffsets[v + 1]; ++j) {
+                tangent += cornerTangents[corners[j]];
+                bitangent += cornerBitangents[corners[j]];
+            }
+            const auto& normal = m_VertexBuffer[first + v].m_Normal;
+            tangent = normalizeOrZero(tangent - normal * glm::dot(normal, tangent));
+            if(tangent == glm::vec3(0.f)) {
+                // No usable texture coordinates: any direction in the tangent plane
+                auto axis = std::abs(normal.x) < .9f ? glm::vec3(1.f, 0.f, 0.f) : glm::vec3(0.f, 1.f, 0.f);
+                tangent = normalizeOrZero(glm::cross(normal, glm::cross(axis, normal)));
+            }
+            float sign = glm::dot(glm::cross(normal, tangent), bitangent) < 0.f ? -1.f : 1.f;
+            m_TangentBuffer[first + v] = glm::vec4(tangent, sign);
+        }
+    });
+}
+
+const Geometry::VertexAttribute Geometry::VERTEX_ATTRIBUTES[VERTEX_ATTRIBUTE_COUNT] = {
+    { 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*) offsetof(Vertex, m_Position) },
+    { 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*) offsetof(Vertex, m_Normal) },
+    { 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*) offsetof(Vertex, m_TexCoords) }
+};
+
+const Geometry::VertexAttribute Geometry::PACKED_VERTEX_ATTRIBUTES[VERTEX_ATTRIBUTE_COUNT] = {
+    { 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (const GLvoid*) offsetof(PackedVertex, m_Position) },
+    { 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (const GLvoid*) offsetof(PackedVertex, m_Normal) },
+    { 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (const GLvoid*) offsetof(PackedVertex, m_TexCoords) }
+};
+
+const Geometry::VertexAttribute Geometry::POSITION_BUFFER_ATTRIBUTE = {
+    3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (const GLvoid*) 0
+};
+
+static_assert(sizeof(Geometry::PackedVertex) == 16, "PackedVertex must stay 16 bytes");
+
+namespace {
+
+// Half floats of the lanes, rounded to nearest
+void storeHalves(const Lanes4& lanes, uint16_t* pHalves) {
+#ifdef GLIMAC_USE_F16C
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(pHalves), _mm_cvtps_ph(lanes.m_Value, _MM_FROUND_TO_NEAREST_INT));
+#else
+    float values[Lanes4::SIZE];
+    lanes.store(values);
+    for(auto i = 0u; i < Lanes4::SIZE; ++i) {
+        pHalves[i] = glm::packHalf1x16(values[i]);
+    }
+#endif
+}
+
+Lanes4 loadHalves(const uint16_t* pHalves) {
+#ifdef GLIMAC_USE_F16C
+    return _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(pHalves)));
+#else
+    float values[Lanes4::SIZE];
+    for(auto i = 0u; i < Lanes4::SIZE; ++i) {
+        values[i] = glm::unpackHalf1x16(pHalves[i]);
+    }
+    return Lanes4::load(values);
+#endif
+}
+
+}
+
+Geometry::PackedVertex Geometry::packVertex(const Vertex& vertex, const BBox3f& packingBox) {
+    PackedVertex packed;
+    auto size = packingBox.size();
+    for(auto i = 0u; i < 3; ++i) {
+        float x = size[i] > 0.f ? (vertex.m_Position[i] - packingBox.lower[i]) / size[i] : 0.f;
+        packed.m_Position[i] = uint16_t(glm::clamp(x, 0.f, 1.f) * 65535.f + .5f);
+    }
+    packed.m_Position[3] = 65535;
+    packed.m_Normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.m_Normal, 0.f));
+    packed.m_TexCoords[0] = glm::packHalf1x16(vertex.m_TexCoords.x);
+    packed.m_TexCoords[1] = glm::packHalf1x16(vertex.m_TexCoords.y);
+    return packed;
+}
+
+Geometry::Vertex Geometry::unpackVertex(const PackedVertex& vertex, const BBox3f& packingBox) {
+    Vertex unpacked;
+    glm::vec3 position(vertex.m_Position[0], vertex.m_Position[1], vertex.m_Position[2]);
+    unpacked.m_Position = packingBox.lower + position / 65535.f * packingBox.size();
+    unpacked.m_Normal = glm::vec3(glm::unpackSnorm3x10_1x2(vertex.m_Normal));
+    unpacked.m_TexCoords = glm::vec2(glm::unpackHalf1x16(vertex.m_TexCoords[0]),
+                                     glm::unpackHalf1x16(vertex.m_TexCoords[1]));
+    return unpacked;
+}
+
+void Geometry::packVertices() {
+    auto start = std::chrono::steady_clock::now();
+
+    // Meshes that share vertices share a box
+    std::vector<unsigned int> meshGroups;
+    auto groups = groupMeshVertices(m_MeshBuffer, 0, m_IndexBuffer, meshGroups);
+    std::vector<BBox3f> boxes;
+    std::vector<unsigned int> vertexBoxes(m_VertexBuffer.size(), NO_VERTEX_GROUP);
+    for(const auto& group: groups) {
+        BBox3f box(m_VertexBuffer[group.m_nFirst].m_Position);
+        for(auto v = group.m_nFirst; v <= group.m_nLast; ++v) {
+            box.grow(m_VertexBuffer[v].m_Position);
+            vertexBoxes[v] = boxes.size();
+        }
+        boxes.push_back(box);
+    }
+    m_PackingBoxes.assign(m_MeshBuffer.size(), BBox3f(glm::vec3(0.f)));
+    for(auto i = 0u; i < m_MeshBuffer.size(); ++i) {
+        if(meshGroups[i] != NO_VERTEX_GROUP) {
+            m_PackingBoxes[i] = boxes[meshGroups[i]];
+        }
+    }
+
+    // As packVertex, Lanes4::SIZE vertices at a time
+    typedef Lanes4 Float;
+    const auto N = Float::SIZE;
+    m_PackedVertexBuffer.resize(m_VertexBuffer.size());
+    parallelForRange(m_VertexBuffer.size(), 4096, [&](size_t begin, size_t end) {
+        for(auto v0 = begin; v0 < end; v0 += N) {
+            // Attributes and box of N vertices by component, the last one
+            // repeated past the end
+            float values[8][N], lower[3][N], size[3][N];
+            for(auto i = 0u; i < N; ++i) {
+                auto v = std::min<size_t>(v0 + i, end - 1);
+                const auto& vertex = m_VertexBuffer[v];
+                // Vertices of no mesh are never drawn
+                auto box = vertexBoxes[v] != NO_VERTEX_GROUP ? boxes[vertexBoxes[v]] : BBox3f(vertex.m_Position);
+                for(auto a = 0u; a < 3; ++a) {
+                    values[a][i] = vertex.m_Position[a];
+                    values[3 + a][i] = vertex.m_Normal[a];
+                    lower[a][i] = box.lower[a];
+                    size[a][i] = box.upper[a] - box.lower[a];
+                }
+                values[6][i] = vertex.m_TexCoords.x;
+                values[7][i] = vertex.m_TexCoords.y;
+            }
+            int32_t positions[3][N], normals[3][N];
+            uint16_t texCoords[2][N];
+            for(auto a = 0u; a < 3; ++a) {
+                auto extent = Float::load(size[a]);
+                auto x = select(Float(0.f) < extent, (Float::load(values[a]) - Float::load(lower[a])) / extent, Float(0.f));
+                (min(max(x, Float(0.f)), Float(1.f)) * Float(65535.f) + Float(.5f)).storeTruncated(positions[a]);
+                // Rounded half away from zero, as glm::packSnorm3x10_1x2
+                auto n = min(max(Float::load(values[3 + a]), Float(-1.f)), Float(1.f)) * Float(511.f);
+                (n + select(n < Float(0.f), Float(-.5f), Float(.5f))).storeTruncated(normals[a]);
+            }
+            storeHalves(Float::load(values[6]), texCoords[0]);
+            storeHalves(Float::load(values[7]), texCoords[1]);
+            for(auto i = 0u; i < N && v0 + i < end; ++i) {
+                auto& packed = m_PackedVertexBuffer[v0 + i];
+                for(auto a = 0u; a < 3; ++a) {
+                    packed.m_Position[a] = uint16_t(positions[a][i]);
+                }
+                packed.m_Position[3] = 65535;
+                packed.m_Normal = (uint32_t(normals[0][i]) & 0x3ff) | (uint32_t(normals[1][i]) & 0x3ff) << 10 |
+                                  (uint32_t(normals[2][i]) & 0x3ff) << 20;
+                packed.m_TexCoords[0] = texCoords[0][i];
+                packed.m_TexCoords[1] = texCoords[1][i];
+            }
+        }
+    });
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::clog << "Pack vertices (" << boxes.size() << " boxes, " << m_VertexBuffer.size() * sizeof(Vertex) / (1024. * 1024.)
+              << " MB -> " << m_PackedVertexBuffer.size() * sizeof(PackedVertex) / (1024. * 1024.) << " MB, "
+              << elapsed.count() << " s)." << std::endl;
+}
+
+void Geometry::unpackVertices() {
+    if(m_PackedVertexBuffer.empty()) {
+        return;
+    }
+    std::vector<unsigned int> meshGroups;
+    auto groups = groupMeshVertices(m_MeshBuffer, 0, m_IndexBuffer, meshGroups);
+    std::vector<BBox3f> boxes(groups.size(), BBox3f(glm::vec3(0.f)));
+    for(auto i = 0u; i < m_MeshBuffer.size(); ++i) {
+        if(meshGroups[i] != NO_VERTEX_GROUP) {
+            boxes[meshGroups[i]] = m_PackingBoxes[i];
+        }
+    }
+    std::vector<unsigned int> vertexBoxes(m_PackedVertexBuffer.size(), NO_VERTEX_GROUP);
+    for(size_t g = 0; g < groups.size(); ++g) {
+        std::fill(vertexBoxes.begin() + groups[g].m_nFirst, vertexBoxes.begin() + groups[g].m_nLast + 1, g);
+    }
+
+    // As unpackVertex, Lanes4::SIZE vertices at a time. The vertices of no
+    // mesh, packed in their own box, come back at the origin.
+    typedef Lanes4 Float;
+    const auto N = Float::SIZE;
+    m_VertexBuffer.resize(m_PackedVertexBuffer.size());
+    parallelForRange(m_PackedVertexBuffer.size(), 4096, [&](size_t begin, size_t end) {
+        for(auto v0 = begin; v0 < end; v0 += N) {
+            float values[6][N], lower[3][N], size[3][N];
+            uint16_t texCoords[2][N];
+            for(auto i = 0u; i < N; ++i) {
+                auto v = std::min<size_t>(v0 + i, end - 1);
+                const auto& packed = m_PackedVertexBuffer[v];
+                auto box = vertexBoxes[v] != NO_VERTEX_GROUP ? boxes[vertexBoxes[v]] : BBox3f(glm::vec3(0.f));
+                for(auto a = 0u; a < 3; ++a) {
+                    values[a][i] = packed.m_Position[a];
+                    // Sign extension of the 10 bits of the component
+                    values[3 + a][i] = float(int32_t(packed.m_Normal << (22 - 10 * a)) >> 22);
+                    lower[a][i] = box.lower[a];
+                    size[a][i] = box.upper[a] - box.lower[a];
+                }
+                texCoords[0][i] = packed.m_TexCoords[0];
+                texCoords[1][i] = packed.m_TexCoords[1];
+            }
+            float attributes[8][N];
+            for(auto a = 0u; a < 3; ++a) {
+                (Float::load(lower[a]) + Float::load(values[a]) / Float(65535.f) * Float::load(size[a])).store(attributes[a]);
+                min(max(Float::load(values[3 + a]) / Float(511.f), Float(-1.f)), Float(1.f)).store(attributes[3 + a]);
+            }
+            loadHalves(texCoords[0]).store(attributes[6]);
+            loadHalves(texCoords[1]).store(attributes[7]);
+            for(auto i = 0u; i < N && v0 + i < end; ++i) {
+                auto& vertex = m_VertexBuffer[v0 + i];
+                vertex.m_Position = glm::vec3(attributes[0][i], attributes[1][i], attributes[2][i]);
+                vertex.m_Normal = glm::vec3(attributes[3][i], attributes[4][i], attributes[5][i]);
+                vertex.m_TexCoords = glm::vec2(attributes[6][i], attributes[7][i]);
+            }
+        }
+    });
+}
+
+void Geometry::releaseVertexBuffer() {
+    if(m_PackedVertexBuffer.size() != m_VertexBuffer.size()) {
+        return;
+    }
+    std::clog << "Release vertex buffer (" << m_VertexBuffer.size() * sizeof(Vertex) / (1024. * 1024.) << " MB)." << std::endl;
+    std::vector<Vertex>().swap(m_VertexBuffer);
+}
+
+namespace {
+
+// Bounds of the vertices referenced by indices. With SSE each position is
+// loaded with the first component of the normal that follows it, and that
+// lane is ignored.
+Geometry::MeshBounds computeBounds(const Geometry::Vertex* pVertices, const unsigned int* pIndices, size_t count) {
+    Geometry::MeshBounds bounds;
+    if(!count) {
+        bounds.m_BBox = BBox3f(glm::vec3(0.f));
+        bounds.m_SphereCenter = glm::vec3(0.f);
+        bounds.m_SphereRadius = 0.f;
+        return bounds;
+    }
+    static_assert(offsetof(Geometry::Vertex, m_Normal) == offsetof(Geometry::Vertex, m_Position) + 12,
+                  "a position and the next float must be loadable at once");
+#ifdef GLIMAC_USE_SSE
+    auto load = [&](size_t i) {
+        return _mm_loadu_ps(&pVertices[pIndices[i]].m_Position.x);
+    };
+    auto lower = load(0), upper = lower;
+    for(size_t i = 1; i < count; ++i) {
+        auto p = load(i);
+        lower = _mm_min_ps(lower, p);
+        upper = _mm_max_ps(upper, p);
+    }
+    float l[4], u[4];
+    _mm_storeu_ps(l, lower);
+    _mm_storeu_ps(u, upper);
+    bounds.m_BBox = BBox3f(glm::vec3(l[0], l[1], l[2]), glm::vec3(u[0], u[1], u[2]));
+    bounds.m_SphereCenter = center(bounds.m_BBox);
+
+    auto c = _mm_setr_ps(bounds.m_SphereCenter.x, bounds.m_SphereCenter.y, bounds.m_SphereCenter.z, 0.f);
+    auto maxDistance = _mm_setzero_ps();
+    for(size_t i = 0; i < count; ++i) {
+        auto d = _mm_sub_ps(load(i), c);
+        d = _mm_mul_ps(d, d);
+        d = _mm_add_ss(_mm_add_ss(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(1, 1, 1, 1))),
+                       _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 2, 2, 2)));
+        maxDistance = _mm_max_ss(maxDistance, d);
+    }
+    bounds.m_SphereRadius = std::sqrt(_mm_cvtss_f32(maxDistance));
+#else
+    bounds.m_BBox = BBox3f(pVertices[pIndices[0]].m_Position);
+    for(size_t i = 1; i < count; ++i) {
+        bounds.m_BBox.grow(pVertices[pIndices[i]].m_Position);
+    }
+    bounds.m_SphereCenter = center(bounds.m_BBox);
+    float maxDistance = 0.f;
+    for(size_t i = 0; i < count; ++i) {
+        auto d = pVertices[pIndices[i]].m_Position - bounds.m_SphereCenter;
+        maxDistance = std::max(maxDistance, glm::dot(d, d));
+    }
+    bounds.m_SphereRadius = std::sqrt(maxDistance);
+#endif
+    return bounds;
+}
+
+}
+
+void Geometry::computeMeshBounds(size_t meshOffset) {
+    m_MeshBounds.resize(m_MeshBuffer.size());
+    parallelFor(m_MeshBuffer.size() - meshOffset, [&](size_t i) {
+        const auto& mesh = m_MeshBuffer[meshOffset + i];
+        m_MeshBounds[meshOffset + i] = computeBounds(m_VertexBuffer.data(), m_IndexBuffer.data() + mesh.m_nIndexOffset,
+                                                     mesh.m_nIndexCount);
+    });
+}
+
+void Geometry::narrowIndices() {
+    m_ShortIndexBuffer.resize(m_IndexBuffer.size());
+    std::atomic<size_t> shortCount { 0 };
+    parallelFor(m_MeshBuffer.size(), [&](size_t i) {
+        auto& mesh = m_MeshBuffer[i];
+        unsigned int first = 0, last = 0;
+        if(mesh.m_nIndexCount) {
+            getIndexRange(m_IndexBuffer.data() + mesh.m_nIndexOffset, mesh.m_nIndexCount, first, last);
+        }
+        mesh.m_nBaseVertex = first;
+        mesh.m_bShortIndices = last - first <= 0xffff;
+        auto pIndices = m_IndexBuffer.data() + mesh.m_nIndexOffset;
+        auto pShortIndices = m_ShortIndexBuffer.data() + mesh.m_nIndexOffset;
+        for(auto j = 0u; j < mesh.m_nIndexCount; ++j) {
+            pShortIndices[j] = mesh.m_bShortIndices ? uint16_t(pIndices[j] - first) : 0;
+        }
+        if(mesh.m_bShortIndices) {
+            shortCount += mesh.m_nIndexCount;
+        }
+    });
+
+    std::clog << "Narrow indices (" << shortCount.load() << " of " << m_IndexBuffer.size() << " indices on 16 bits)."
+              << std::endl;
+}
+
+void Geometry::encodeIndices(const unsigned int* pIndices, size_t count, std::vector<unsigned char>& data) {
+    unsigned int previous = 0;
+    for(size_t i = 0; i < count; ++i) {
+        // Zigzag: small differences of both signs give small values
+        unsigned int delta = pIndices[i] - previous;
+        unsigned int value = (delta << 1) ^ (0u - (delta >> 31));
+        previous = pIndices[i];
+        while(value >= 0x80) {
+            data.push_back((unsigned char) (value | 0x80));
+            value >>= 7;
+        }
+        data.push_back((unsigned char) value);
+    }
+}
+
+size_t Geometry::decodeIndices(const unsigned char* pData, size_t size, unsigned int* pIndices, size_t count) {
+    auto pByte = pData;
+    auto pEnd = pData + size;
+    unsigned int previous = 0;
+    for(size_t i = 0; i < count; ++i) {
+        if(pByte == pEnd) {
+            return 0;
+        }
+        unsigned int value = *pByte++;
+        if(value >= 0x80) {
+            value &= 0x7f;
+            for(unsigned int shift = 7; ; shift += 7) {
+                if(pByte == pEnd || shift > 28) {
+                    return 0;
+                }
+                unsigned int byte = *pByte++;
+                value |= (byte & 0x7f) << shift;
+                if(byte < 0x80) {
+                    break;
+                }
+            }
+        }
+        previous += (value >> 1) ^ (0u - (value & 1));
+        pIndices[i] = previous;
+    }
+    return pByte - pData;
+}
+
+namespace {
+
+// Bucket of a cell of the welding grid among bucketCount, a power of 2
+unsigned int getWeldBucket(const glm::vec3& cell, unsigned int group, unsigned int bucketCount) {
+    uint32_t bits[3];
+    std::memcpy(bits, &cell, sizeof(bits));
+    uint32_t h = bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u ^ group * 2654435761u;
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return h & (bucketCount - 1);
+}
+
+// Moves the elements of a vertex stream in sync with the vertex buffer to
+// the new index of their vertex, the kept vertices being numbered in order
+template<typename T>
+void compactVertexStream(std::vector<T>& stream, size_t vertexCount, size_t vertexOffset,
+                         const std::vector<unsigned int>& newIndices, size_t newVertexCount) {
+    if(stream.size() != vertexCount) {
+        return;
+    }
+    size_t next = 0;
+    for(size_t i = 0; i < newIndices.size(); ++i) {
+        // Merged vertices get the index of an earlier one
+        if(newIndices[i] == next) {
+            stream[vertexOffset + next++] = stream[vertexOffset + i];
+        }
+    }
+    stream.resize(vertexOffset + newVertexCount);
+}
+
+}
+
+void Geometry::weldVertices(size_t vertexOffset, size_t meshOffset, float positionTolerance, float normalAngle,
+                            float texCoordsTolerance) {
+    auto start = std::chrono::steady_clock::now();
+    auto vertexCount = m_VertexBuffer.size() - vertexOffset;
+
+    // Only the vertices of a same shape are merged, so that meshes keep
+    // their own range of vertices
+    std::vector<unsigned int> meshGroups;
+    auto groups = groupMeshVertices(m_MeshBuffer, meshOffset, m_IndexBuffer, meshGroups);
+    std::vector<unsigned int> vertexGroups(vertexCount, NO_VERTEX_GROUP);
+    for(auto g = 0u; g < groups.size(); ++g) {
+        for(auto v = std::max<size_t>(groups[g].m_nFirst, vertexOffset); v <= groups[g].m_nLast; ++v) {
+            vertexGroups[v - vertexOffset] = g;
+        }
+    }
+
+    // Spatial hash: the vertices of each bucket by increasing index. Cells
+    // are twice the tolerance so that the vertices within it are in the 8
+    // cells on the side of the nearest corner.
+    float distance = positionTolerance * glm::length(m_BBox.size());
+    float cellSize = distance > 0.f ? 2.f * distance : 1.f;
+    auto bucketCount = 1u;
+    while(bucketCount < 2 * vertexCount) {
+        bucketCount *= 2;
+    }
+    // + 0.f turns -0 into 0, the cell reached from the cells around
+    auto getCell = [&](const glm::vec3& position) {
+        return glm::floor(position / cellSize) + 0.f;
+    };
+    std::vector<unsigned int> vertexBuckets(vertexCount);
+    std::vector<unsigned int> bucketOffsets(bucketCount + 1, 0);
+    parallelForRange(vertexCount, 1 << 14, [&](size_t begin, size_t end) {
+        for(auto v = begin; v < end; ++v) {
+            if(vertexGroups[v] != NO_VERTEX_GROUP) {
+                vertexBuckets[v] = getWeldBucket(getCell(m_VertexBuffer[vertexOffset + v].m_Position),
+                                                 vertexGroups[v], bucketCount);
+            }
+        }
+    });
+    for(size_t v = 0; v < vertexCount; ++v) {
+        if(vertexGroups[v] != NO_VERTEX_GROUP) {
+            ++bucketOffsets[vertexBuckets[v] + 1];
+        }
+    }
+    for(auto b = 0u; b < bucketCount; ++b) {
+        bucketOffsets[b + 1] += bucketOffsets[b];
+    }
+    std::vector<unsigned int> bucketVertices(bucketOffsets[bucketCount]);
+    {
+        auto fill = bucketOffsets;
+        for(size_t v = 0; v < vertexCount; ++v) {
+            if(vertexGroups[v] != NO_VERTEX_GROUP) {
+                bucketVertices[fill[vertexBuckets[v]]++] = v;
+            }
+        }
+    }
+
+    // Lowest matching vertex of each vertex
+    float squaredDistance = distance * distance;
+    float cosAngle = std::cos(normalAngle);
+    auto matches = [&](const Vertex& a, const Vertex& b) {
+        auto d = a.m_Position - b.m_Position;
+        auto t = glm::abs(a.m_TexCoords - b.m_TexCoords);
+        return glm::dot(d, d) <= squaredDistance && t.x <= texCoordsTolerance && t.y <= texCoordsTolerance &&
+               (glm::dot(a.m_Normal, b.m_Normal) >= cosAngle || a.m_Normal == b.m_Normal);
+    };
+    std::vector<unsigned int> newIndices(vertexCount);
+    parallelForRange(vertexCount, 1 << 12, [&](size_t begin, size_t end) {
+        for(auto v = begin; v < end; ++v) {
+            newIndices[v] = v;
+            if(vertexGroups[v] == NO_VERTEX_GROUP) {
+                continue;
+            }
+            const auto& vertex = m_VertexBuffer[vertexOffset + v];
+            auto cell = getCell(vertex.m_Position);
+            auto side = 2.f * glm::step(.5f, glm::fract(vertex.m_Position / cellSize)) - 1.f;
+            for(auto z = 0; z <= 1; ++z) {
+                for(auto y = 0; y <= 1; ++y) {
+                    for(auto x = 0; x <= 1; ++x) {
+                        auto b = getWeldBucket(cell + side * glm::vec3(x, y, z), vertexGroups[v], bucketCount);
+                        for(auto i = bucketOffsets[b]; i < bucketOffsets[b + 1] && bucketVertices[i] < newIndices[v]; ++i) {
+                            auto u = bucketVertices[i];
+                            if(vertexGroups[u] == vertexGroups[v] && matches(m_VertexBuffer[vertexOffset + u], vertex)) {
+                                newIndices[v] = u;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    // Vertices go to the end of their chain if it matches them too, so that
+    // v -> u -> w doesn't merge v into a w beyond the tolerance of v. A
+    // vertex whose match went to such a w stays. The remaining vertices are
+    // numbered in order.
+    std::vector<unsigned int> roots(vertexCount);
+    size_t newVertexCount = 0;
+    for(size_t v = 0; v < vertexCount; ++v) {
+        auto u = newIndices[v];
+        auto root = u == v ? v : roots[u];
+        if(root != u && !matches(m_VertexBuffer[vertexOffset + root], m_VertexBuffer[vertexOffset + v])) {
+            root = v;
+        }
+        roots[v] = root;
+        newIndices[v] = root == v ? newVertexCount++ : newIndices[root];
+    }
+    if(newVertexCount == vertexCount) {
+        std::clog << "Weld vertices (nothing to merge among " << vertexCount << " vertices)." << std::endl;
+        return;
+    }
+
+    auto remap = [&](std::vector<unsigned int>& indices) {
+        parallelForRange(indices.size(), 1 << 16, [&](size_t begin, size_t end) {
+            for(auto i = begin; i < end; ++i) {
+                if(indices[i] >= vertexOffset) {
+                    indices[i] = vertexOffset + newIndices[indices[i] - vertexOffset];
+                }
+            }
+        });
+    };
+    remap(m_IndexBuffer);
+    remap(m_MeshletVertexBuffer);
+    remap(m_LodIndexBuffer);
+    auto oldVertexCount = m_VertexBuffer.size();
+    compactVertexStream(m_PositionBuffer, oldVertexCount, vertexOffset, newIndices, newVertexCount);
+    compactVertexStream(m_TangentBuffer, oldVertexCount, vertexOffset, newIndices, newVertexCount);
+    compactVertexStream(m_PackedVertexBuffer, oldVertexCount, vertexOffset, newIndices, newVertexCount);
+    compactVertexStream(m_VertexBuffer, oldVertexCount, vertexOffset, newIndices, newVertexCount);
+    if(!m_ShortIndexBuffer.empty()) {
+        narrowIndices();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::clog << "Weld vertices (" << vertexCount << " -> " << newVertexCount << " vertices, "
+              << float(vertexCount) / newVertexCount << " times fewer, " << elapsed.count() << " s)." << std::endl;
+}
+
+namespace {
+
+struct VertexCacheCounts {
+    size_t m_nMisses = 0;
+    size_t m_nTriangles = 0;
+    size_t m_nVertices = 0; // Distinct vertices
+
+    VertexCacheCounts& operator +=(const VertexCacheCounts& other) {
+        m_nMisses += other.m_nMisses;
+        m_nTriangles += other.m_nTriangles;
+        m_nVertices += other.m_nVertices;
+        return *this;
+    }
+
+    Geometry::VertexCacheStats getStats() const {
+        Geometry::VertexCacheStats stats;
+        stats.m_ACMR = m_nTriangles ? float(m_nMisses) / m_nTriangles : 0.f;
+        stats.m_ATVR = m_nVertices ? float(m_nMisses) / m_nVertices : 0.f;
+        return stats;
+    }
+};
+
+VertexCacheCounts simulateVertexCache(const unsigned int* pIndices, size_t indexCount, unsigned int cacheSize) {
+    VertexCacheCounts counts;
+    counts.m_nTriangles = indexCount / 3;
+    unsigned int first, last;
+    getIndexRange(pIndices, indexCount, first, last);
+
+    // A vertex is in the FIFO while fewer than cacheSize misses followed its own
+    std::vector<size_t> missTimes(indexCount ? last - first + 1 : 0, 0);
+    for(size_t i = 0; i < indexCount; ++i) {
+        auto& time = missTimes[pIndices[i] - first];
+        if(!time || counts.m_nMisses - time >= cacheSize) {
+            counts.m_nVertices += !time;
+            time = ++counts.m_nMisses;
+        }
+    }
+    return counts;
+}
+
+// Tipsify from "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw", Sander et al. 2007: fans around a vertex, then moves to the
+// vertex of the fan that will still be in the cache with the most triangles
+// left, or to a dead end when none will.
+void tipsify(unsigned int* pIndices, size_t indexCount, unsigned int cacheSize) {
+    auto triangleCount = indexCount / 3;
+    unsigned int first, last;
+    getIndexRange(pIndices, indexCount, first, last);
+    if(!triangleCount) {
+        return;
+    }
+    int vertexCount = last - first + 1;
+
+    // Triangles of each vertex, in compressed rows
+    std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+    for(size_t i = 0; i < 3 * triangleCount; ++i) {
+        ++adjacencyOffsets[pIndices[i] - first + 1];
+    }
+    for(int v = 0; v < vertexCount; ++v) {
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    }
+    std::vector<unsigned int> adjacency(3 * triangleCount);
+    std::vector<int> liveTriangles(vertexCount);
+    for(int v = 0; v < vertexCount; ++v) {
+        liveTriangles[v] = adjacencyOffsets[v + 1] - adjacencyOffsets[v];
+    }
+    {
+        std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for(size_t i = 0; i < 3 * triangleCount; ++i) {
+            adjacency[fill[pIndices[i] - first]++] = i / 3;
+        }
+    }
+
+    std::vector<size_t> cacheTimes(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<int> deadEnds, candidates;
+    std::vector<unsigned int> output;
+    output.reserve(3 * triangleCount);
+    size_t time = cacheSize + 1;
+    int cursor = 0;
+
+    int fanning = 0;
+    while(fanning >= 0) {
+        candidates.clear();
+        for(auto j = adjacencyOffsets[fanning]; j < adjacencyOffsets[fanning + 1]; ++j) {
+            auto t = adjacency[j];
+            if(emitted[t]) {
+                continue;
+            }
+            emitted[t] = true;
+            for(auto k = 0u; k < 3; ++k) {
+                auto index = pIndices[3 * t + k];
+                int v = index - first;
+                output.push_back(index);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                --liveTriangles[v];
+                if(time - cacheTimes[v] > cacheSize) {
+                    cacheTimes[v] = time++;
+                }
+            }
+        }
+
+        // Next fanning vertex
+        fanning = -1;
+        int bestPriority = -1;
+        for(auto v: candidates) {
+            if(liveTriangles[v] <= 0) {
+                continue;
+            }
+            int priority = 0;
+            if(time - cacheTimes[v] + 2 * liveTriangles[v] <= cacheSize) {
+                priority = time - cacheTimes[v];
+            }
+            if(priority > bestPriority) {
+                bestPriority = priority;
+                fanning = v;
+            }
+        }
+        while(fanning < 0 && !deadEnds.empty()) {
+            auto v = deadEnds.back();
+            deadEnds.pop_back();
+            if(liveTriangles[v] > 0) {
+                fanning = v;
+            }
+        }
+        for(; fanning < 0 && cursor < vertexCount; ++cursor) {
+            if(liveTriangles[cursor] > 0) {
+                fanning = cursor;
+            }
+        }
+    }
+
+    // Trailing indices of an incomplete triangle stay in place
+    std::copy(output.begin(), output.end(), pIndices);
+}
+
+}
+
+Geometry::VertexCacheStats Geometry::getVertexCacheStats(unsigned int cacheSize) const {
+    std::vector<VertexCacheCounts> meshCounts(m_MeshBuffer.size());
+    parallelFor(m_MeshBuffer.size(), [&](size_t i) {
+        const auto& mesh = m_MeshBuffer[i];
+        meshCounts[i] = simulateVertexCache(m_IndexBuffer.data() + mesh.m_nIndexOffset, mesh.m_nIndexCount, cacheSize);
+    });
+    VertexCacheCounts counts;
+    for(const auto& meshCount: meshCounts) {
+        counts += meshCount;
+    }
+    return counts.getStats();
+}
+
+void Geometry::optimizeVertexCache(size_t meshOffset, unsigned int cacheSize) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<VertexCacheCounts> before(m_MeshBuffer.size() - meshOffset), after(before.size());
+    parallelFor(before.size(), [&](size_t i) {
+        const auto& mesh = m_MeshBuffer[meshOffset + i];
+        auto pIndices = m_IndexBuffer.data() + mesh.m_nIndexOffset;
+        before[i] = simulateVertexCache(pIndices, mesh.m_nIndexCount, cacheSize);
+        tipsify(pIndices, mesh.m_nIndexCount, cacheSize);
+        after[i] = simulateVertexCache(pIndices, mesh.m_nIndexCount, cacheSize);
+    });
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    VertexCacheCounts countsBefore, countsAfter;
+    for(auto i = 0u; i < before.size(); ++i) {
+        countsBefore += before[i];
+        countsAfter += after[i];
+    }
+    auto statsBefore = countsBefore.getStats(), statsAfter = countsAfter.getStats();
+    std::clog << "Optimize vertex cache (ACMR " << statsBefore.m_ACMR << " -> " << statsAfter.m_ACMR
+              << ", ATVR " << statsBefore.m_ATVR << " -> " << statsAfter.m_ATVR
+              << ", " << elapsed.count() << " s)." << std::endl;
+}
+
+namespace {
+
+// Cache lines missed when reading the vertices referenced by the indices
+size_t countVertexFetchMisses(const Geometry::Vertex* pVertices, const unsigned int* pIndices, size_t indexCount) {
+    const size_t lineSize = 64, lineCount = (32 << 10) / lineSize;
+    std::vector<uintptr_t> lines(lineCount, ~uintptr_t(0));
+    size_t misses = 0;
+    for(size_t i = 0; i < indexCount; ++i) {
+        auto address = uintptr_t(pVertices + pIndices[i]);
+        for(auto line = address / lineSize; line <= (address + sizeof(Geometry::Vertex) - 1) / lineSize; ++line) {
+            if(lines[line % lineCount] != line) {
+                lines[line % lineCount] = line;
+                lines[(line + 1) % lineCount] = line + 1;
+                ++misses;
+            }
+        }
+    }
+    return misses;
+}
+
+// Moves the elements of a vertex stream in sync with the vertex buffer from
+// vertexOffset on to the new index of their vertex
+template<typename T>
+void reorderVertexStream(std::vector<T>& stream, size_t vertexCount, size_t vertexOffset,
+                         const std::vector<unsigned int>& newIndices) {
+    if(stream.size() != vertexCount) {
+        return;
+    }
+    std::vector<T> reordered(newIndices.size());
+    for(size_t i = 0; i < newIndices.size(); ++i) {
+        reordered[newIndices[i]] = stream[vertexOffset + i];
+    }
+    std::copy(reordered.begin(), reordered.end(), stream.begin() + vertexOffset);
+}
+
+}
+
+float Geometry::getVertexFetchMissRatio() const {
+    if(m_IndexBuffer.size() < 3) {
+        return 0.f;
+    }
+    return float(countVertexFetchMisses(m_VertexBuffer.data(), m_IndexBuffer.data(), m_IndexBuffer.size())) /
+           (m_IndexBuffer.size() / 3);
+}
+
+void Geometry::optimizeVertexFetch(size_t vertexOffset, size_t meshOffset) {
+    auto start = std::chrono::steady_clock::now();
+    auto indexOffset = meshOffset < m_MeshBuffer.size() ? m_MeshBuffer[meshOffset].m_nIndexOffset : m_IndexBuffer.size();
+    auto triangleCount = std::max<size_t>(1, (m_IndexBuffer.size() - indexOffset) / 3);
+    auto missesBefore = countVertexFetchMisses(m_VertexBuffer.data(), m_IndexBuffer.data() + indexOffset,
+                                               m_IndexBuffer.size() - indexOffset);
+
+    // Meshes of a shape share vertices: the first mesh to use one places it
+    const auto unused = ~0u;
+    std::vector<unsigned int> newIndices(m_VertexBuffer.size() - vertexOffset, unused);
+    unsigned int nextIndex = 0;
+    for(auto i = meshOffset; i < m_MeshBuffer.size(); ++i) {
+        const auto& mesh = m_MeshBuffer[i];
+        for(auto j = mesh.m_nIndexOffset; j < mesh.m_nIndexOffset + mesh.m_nIndexCount; ++j) {
+            auto& newIndex = newIndices[m_IndexBuffer[j] - vertexOffset];
+            if(newIndex == unused) {
+                newIndex = nextIndex++;
+            }
+            m_IndexBuffer[j] = vertexOffset + newIndex;
+        }
+    }
+
+    // Unused vertices go last
+    for(auto& newIndex: newIndices) {
+        if(newIndex == unused) {
+            newIndex = nextIndex++;
+        }
+    }
+
+    // The meshlets and the LODs built before follow their vertices
+    auto remap = [&](std::vector<unsigned int>& indices) {
+        for(auto& index: indices) {
+            if(index >= vertexOffset) {
+                index = vertexOffset + newIndices[index - vertexOffset];
+            }
+        }
+    };
+    remap(m_MeshletVertexBuffer);
+    remap(m_LodIndexBuffer);
+    auto vertexCount = m_VertexBuffer.size();
+    reorderVertexStream(m_VertexBuffer, vertexCount, vertexOffset, newIndices);
+    reorderVertexStream(m_TangentBuffer, vertexCount, vertexOffset, newIndices);
+    reorderVertexStream(m_PackedVertexBuffer, vertexCount, vertexOffset, newIndices);
+    reorderVertexStream(m_PositionBuffer, vertexCount, vertexOffset, newIndices);
+    if(!m_ShortIndexBuffer.empty()) {
+        narrowIndices();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    auto missesAfter = countVertexFetchMisses(m_VertexBuffer.data(), m_IndexBuffer.data() + indexOffset,
+                                              m_IndexBuffer.size() - indexOffset);
+    std::clog << "Optimize vertex fetch (cache line misses per triangle " << float(missesBefore) / triangleCount
+              << " -> " << float(missesAfter) / triangleCount << ", " << elapsed.count() << " s)." << std::endl;
+}
+
+namespace {
+
+struct MeshletBuffers {
+    std::vector<Geometry::Meshlet> m_Meshlets;
+    std::vector<unsigned int> m_Vertices;
+    std::vector<unsigned char> m_Triangles;
+};
+
+// Bounds and normal cone of a meshlet, the cone as in meshoptimizer: the
+// apex is moved back along the axis until all the triangle planes are in
+// front of it, so that the test holds for perspective views.
+void computeMeshletBounds(Geometry::Meshlet& meshlet, const Geometry::Vertex* pVertices,
+                          const unsigned int* pMeshletVertices, const unsigned char* pMeshletTriangles) {
+    auto vertices = pMeshletVertices + meshlet.m_nVertexOffset;
+    auto triangles = pMeshletTriangles + 3 * meshlet.m_nTriangleOffset;
+
+    meshlet.m_BBox = BBox3f(pVertices[vertices[0]].m_Position);
+    for(auto i = 1u; i < meshlet.m_nVertexCount; ++i) {
+        meshlet.m_BBox.grow(pVertices[vertices[i]].m_Position);
+    }
+    boundingSphere(meshlet.m_BBox, meshlet.m_SphereCenter, meshlet.m_SphereRadius);
+
+    meshlet.m_ConeApex = meshlet.m_SphereCenter;
+    meshlet.m_ConeAxis = glm::vec3(0.f);
+    meshlet.m_ConeCutoff = 1.f;
+
+    // Unit normal of triangle i, false if it is degenerate
+    auto getTriangle = [&](unsigned int i, glm::vec3& p0, glm::vec3& n) {
+        p0 = pVertices[vertices[triangles[3 * i]]].m_Position;
+        n = glm::cross(pVertices[vertices[triangles[3 * i + 1]]].m_Position - p0,
+                       pVertices[vertices[triangles[3 * i + 2]]].m_Position - p0);
+        float length = glm::length(n);
+        n /= length;
+        return length > 0.f;
+    };
+
+    glm::vec3 p0, n, axis(0.f);
+    for(auto i = 0u; i < meshlet.m_nTriangleCount; ++i) {
+        if(getTriangle(i, p0, n)) {
+            axis += n;
+        }
+    }
+    float axisLength = glm::length(axis);
+    if(axisLength == 0.f) {
+        return;
+    }
+    axis /= axisLength;
+
+    float minDot = 1.f;
+    for(auto i = 0u; i < meshlet.m_nTriangleCount; ++i) {
+        if(getTriangle(i, p0, n)) {
+            minDot = std::min(minDot, glm::dot(axis, n));
+        }
+    }
+    // Past about 84 degrees the apex goes too far for the cone to cull anything
+    if(minDot <= .1f) {
+        return;
+    }
+
+    float maxT = 0.f;
+    for(auto i = 0u; i < meshlet.m_nTriangleCount; ++i) {
+        if(getTriangle(i, p0, n)) {
+            maxT = std::max(maxT, glm::dot(meshlet.m_SphereCenter - p0, n) / glm::dot(axis, n));
+        }
+    }
+    meshlet.m_ConeApex = meshlet.m_SphereCenter - axis * maxT;
+    meshlet.m_ConeAxis = axis;
+    meshlet.m_ConeCutoff = std::sqrt(1.f - minDot * minDot);
+}
+
+// Greedy split of the triangles in index order, offsets relative to the buffers
+void buildMeshMeshlets(const Geometry::Vertex* pVertices, const unsigned int* pIndices, size_t indexCount,
+                       unsigned int maxVertexCount, unsigned int maxTriangleCount, MeshletBuffers& buffers) {
+    unsigned int first, last;
+    getIndexRange(pIndices, indexCount, first, last);
+    // Position of each vertex of the mesh in the current meshlet, -1 if not in it
+    std::vector<int> slots(indexCount ? last - first + 1 : 0, -1);
+
+    Geometry::Meshlet meshlet;
+    meshlet.m_nVertexOffset = meshlet.m_nVertexCount = meshlet.m_nTriangleOffset = meshlet.m_nTriangleCount = 0;
+    auto flush = [&]() {
+        for(auto i = meshlet.m_nVertexOffset; i < buffers.m_Vertices.size(); ++i) {
+            slots[buffers.m_Vertices[i] - first] = -1;
+        }
+        computeMeshletBounds(meshlet, pVertices, buffers.m_Vertices.data(), buffers.m_Triangles.data());
+        buffers.m_Meshlets.push_back(meshlet);
+        meshlet.m_nVertexOffset = buffers.m_Vertices.size();
+        meshlet.m_nTriangleOffset = buffers.m_Triangles.size() / 3;
+        meshlet.m_nVertexCount = meshlet.m_nTriangleCount = 0;
+    };
+
+    for(size_t i = 0; i + 2 < indexCount; i += 3) {
+        auto a = pIndices[i], b = pIndices[i + 1], c = pIndices[i + 2];
+        auto newVertexCount = (slots[a - first] < 0) + (b != a && slots[b - first] < 0) +
+                              (c != a && c != b && slots[c - first] < 0);
+        if(meshlet.m_nVertexCount + newVertexCount > maxVertexCount || meshlet.m_nTriangleCount == maxTriangleCount) {
+            flush();
+        }
+        for(auto index: { a, b, c }) {
+            auto& slot = slots[index - first];
+            if(slot < 0) {
+                slot = meshlet.m_nVertexCount++;
+                buffers.m_Vertices.push_back(index);
+            }
+            buffers.m_Triangles.push_back(slot);
+        }
+        ++meshlet.m_nTriangleCount;
+    }
+    if(meshlet.m_nTriangleCount) {
+        flush();
+    }
+}
+
+}
+
+void Geometry::buildMeshlets(unsigned int maxVertexCount, unsigned int maxTriangleCount) {
+    m_MeshletBuffer.clear();
+    m_MeshletVertexBuffer.clear();
+    m_MeshletTriangleBuffer.clear();
+    buildMeshlets(0, maxVertexCount, maxTriangleCount);
+}
+
+void Geometry::buildMeshlets(size_t meshOffset, unsigned int maxVertexCount, unsigned int maxTriangleCount) {
+    // Local indices are bytes
+    maxVertexCount = std::max(3u, std::min(256u, maxVertexCount));
+    maxTriangleCount = std::max(1u, maxTriangleCount);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<MeshletBuffers> meshBuffers(m_MeshBuffer.size() - meshOffset);
+    parallelFor(meshBuffers.size(), [&](size_t i) {
+        const auto& mesh = m_MeshBuffer[meshOffset + i];
+        buildMeshMeshlets(m_VertexBuffer.data(), m_IndexBuffer.data() + mesh.m_nIndexOffset, mesh.m_nIndexCount,
+                          maxVertexCount, maxTriangleCount, meshBuffers[i]);
+    });
+
+    auto meshletOffset = m_MeshletBuffer.size();
+    for(auto i = 0u; i < meshBuffers.size(); ++i) {
+        auto& mesh = m_MeshBuffer[meshOffset + i];
+        auto& buffers = meshBuffers[i];
+        unsigned int vertexOffset = m_MeshletVertexBuffer.size();
+        unsigned int triangleOffset = m_MeshletTriangleBuffer.size() / 3;
+        mesh.m_nMeshletOffset = m_MeshletBuffer.size();
+        mesh.m_nMeshletCount = buffers.m_Meshlets.size();
+        for(auto& meshlet: buffers.m_Meshlets) {
+            meshlet.m_nVertexOffset += vertexOffset;
+            meshlet.m_nTriangleOffset += triangleOffset;
+            m_MeshletBuffer.push_back(meshlet);
+        }
+        m_MeshletVertexBuffer.insert(m_MeshletVertexBuffer.end(), buffers.m_Vertices.begin(), buffers.m_Vertices.end());
+        m_MeshletTriangleBuffer.insert(m_MeshletTriangleBuffer.end(), buffers.m_Triangles.begin(), buffers.m_Triangles.end());
+        std::vector<unsigned int>().swap(buffers.m_Vertices);
+        std::vector<unsigned char>().swap(buffers.m_Triangles);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    auto meshletCount = std::max<size_t>(1, m_MeshletBuffer.size() - meshletOffset);
+    size_t vertexCount = 0, triangleCount = 0;
+    for(auto i = meshletOffset; i < m_MeshletBuffer.size(); ++i) {
+        vertexCount += m_MeshletBuffer[i].m_nVertexCount;
+        triangleCount += m_MeshletBuffer[i].m_nTriangleCount;
+    }
+    std::clog << "Build meshlets (" << m_MeshletBuffer.size() - meshletOffset << " meshlets, "
+              << float(vertexCount) / meshletCount << " vertices and " << float(triangleCount) / meshletCount
+              << " triangles on average, " << elapsed.count() << " s)." << std::endl;
+}
+
+namespace {
+
+// Sum of the squared distances to a set of planes
+struct Quadric {
+    double a00, a01, a02, a11, a12, a22, b0, b1, b2, c;
+
+    Quadric(): a00(0), a01(0), a02(0), a11(0), a12(0), a22(0), b0(0), b1(0), b2(0), c(0) {
+    }
+
+    // Plane of unit normal n through p
+    Quadric(const glm::dvec3& n, const glm::dvec3& p) {
+        double d = -glm::dot(n, p);
+        a00 = n.x * n.x; a01 = n.x * n.y; a02 = n.x * n.z;
+        a11 = n.y * n.y; a12 = n.y * n.z; a22 = n.z * n.z;
+        b0 = n.x * d; b1 = n.y * d; b2 = n.z * d;
+        c = d * d;
+    }
+
+    Quadric& operator +=(const Quadric& q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02;
+        a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        return *this;
+    }
+
+    double evaluate(const glm::vec3& p) const {
+        double x = p.x, y = p.y, z = p.z;
+        return std::max(0., a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + a11 * y * y + 2 * a12 * y * z +
+                            a22 * z * z + 2 * (b0 * x + b1 * y + b2 * z) + c);
+    }
+};
+
+// Quadric error edge collapse onto existing vertices, in passes: each pass
+// collapses the cheapest edges that share no vertex with one another, then
+// compacts the triangles. Vertices on an open or non-manifold edge are locked,
+// which keeps borders, UV seams and material seams in place.
+class MeshSimplifier {
+public:
+    MeshSimplifier(const Geometry::Vertex* pVertices, const unsigned int* pIndices, size_t indexCount):
+        m_Indices(pIndices, pIndices + indexCount - indexCount % 3), m_Error(0) {
+        unsigned int last;
+        getIndexRange(pIndices, indexCount, m_nFirst, last);
+        size_t vertexCount = indexCount ? last - m_nFirst + 1 : 0;
+        for(auto& index: m_Indices) {
+            index -= m_nFirst;
+        }
+        m_Positions.resize(vertexCount);
+        for(size_t i = 0; i < vertexCount; ++i) {
+            m_Positions[i] = pVertices[m_nFirst + i].m_Position;
+        }
+
+        m_Quadrics.resize(vertexCount);
+        std::vector<uint64_t> edges;
+        edges.reserve(m_Indices.size());
+        for(size_t i = 0; i < m_Indices.size(); i += 3) {
+            glm::dvec3 p0(m_Positions[m_Indices[i]]), p1(m_Positions[m_Indices[i + 1]]), p2(m_Positions[m_Indices[i + 2]]);
+            auto n = glm::cross(p1 - p0, p2 - p0);
+            if(glm::length(n) > 0.) {
+                Quadric q(glm::normalize(n), p0);
+                for(auto k = 0u; k < 3; ++k) {
+                    m_Quadrics[m_Indices[i + k]] += q;
+                }
+            }
+            for(auto k = 0u; k < 3; ++k) {
+                uint64_t a = m_Indices[i + k], b = m_Indices[i + (k + 1) % 3];
+                edges.push_back(std::min(a, b) << 32 | std::max(a, b));
+            }
+        }
+
+        // An edge of a closed manifold surface belongs to two triangles
+        m_Locked.resize(vertexCount, false);
+        std::sort(edges.begin(), edges.end());
+        for(size_t i = 0, j; i < edges.size(); i = j) {
+            for(j = i + 1; j < edges.size() && edges[j] == edges[i]; ++j) {
+            }
+            if(j - i != 2) {
+                m_Locked[edges[i] >> 32] = true;
+                m_Locked[edges[i] & 0xffffffff] = true;
+            }
+        }
+    }
+
+    // Collapses edges until at most targetTriangleCount triangles are left or
+    // the next collapse would exceed maxError. Returns the error reached.
+    float simplify(size_t targetTriangleCount, float maxError) {
+        double maxCost = double(maxError) * maxError;
+        while(m_Indices.size() / 3 > targetTriangleCount && collapse(targetTriangleCount, maxCost)) {
+        }
+        return float(std::sqrt(m_Error));
+    }
+
+    // Indices of the current triangles in the vertices of the geometry
+    void getIndices(std::vector<unsigned int>& indices) const {
+        for(auto index: m_Indices) {
+            indices.push_back(m_nFirst + index);
+        }
+    }
+
+    size_t getTriangleCount() const {
+        return m_Indices.size() / 3;
+    }
+
+private:
+    struct Collapse {
+        unsigned int m_nFrom, m_nTo;
+        double m_Cost;
+
+        bool operator <(const Collapse& other) const {
+            return m_Cost < other.m_Cost;
+        }
+    };
+
+    // One pass, returns false if no edge could be collapsed
+    bool collapse(size_t targetTriangleCount, double maxCost) {
+        auto vertexCount = m_Positions.size();
+        auto triangleCount = m_Indices.size() / 3;
+
+        // Triangles of each vertex, in compressed rows
+        std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+        for(auto index: m_Indices) {
+            ++adjacencyOffsets[index + 1];
+        }
+        for(size_t v = 0; v < vertexCount; ++v) {
+            adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        }
+        std::vector<unsigned int> adjacency(m_Indices.size());
+        {
+            std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for(size_t i = 0; i < m_Indices.size(); ++i) {
+                adjacency[fill[m_Indices[i]]++] = i / 3;
+            }
+        }
+
+        std::vector<Collapse> collapses;
+        collapses.reserve(m_Indices.size() / 2);
+        for(size_t i = 0; i < m_Indices.size(); ++i) {
+            auto a = m_Indices[i], b = m_Indices[i - i % 3 + (i + 1) % 3];
+            // Each interior edge is seen once in each direction
+            if(a >= b || (m_Locked[a] && m_Locked[b])) {
+                continue;
+            }
+            auto q = m_Quadrics[a];
+            q += m_Quadrics[b];
+            Collapse c;
+            double costAB = m_Locked[a] ? HUGE_VAL : q.evaluate(m_Positions[b]);
+            double costBA = m_Locked[b] ? HUGE_VAL : q.evaluate(m_Positions[a]);
+            if(costAB <= costBA) {
+                c.m_nFrom = a;
+                c.m_nTo = b;
+                c.m_Cost = costAB;
+            } else {
+                c.m_nFrom = b;
+                c.m_nTo = a;
+                c.m_Cost = costBA;
+            }
+            if(c.m_Cost <= maxCost) {
+                collapses.push_back(c);
+            }
+        }
+        std::sort(collapses.begin(), collapses.end());
+
+        // Small steps keep the quadrics of the neighbourhoods up to date
+        auto removableCount = std::min(triangleCount - targetTriangleCount, std::max<size_t>(1, triangleCount / 6));
+        std::vector<unsigned int> remap(vertexCount);
+        for(size_t v = 0; v < vertexCount; ++v) {
+            remap[v] = v;
+        }
+        std::vector<bool> touched(vertexCount, false);
+        size_t removedCount = 0, collapseCount = 0;
+        for(const auto& c: collapses) {
+            if(removedCount >= removableCount) {
+                break;
+            }
+            if(touched[c.m_nFrom] || touched[c.m_nTo]) {
+                continue;
+            }
+
+            // Triangles around the removed vertex either disappear or must not flip
+            size_t sharedCount = 0;
+            bool flips = false;
+            for(auto j = adjacencyOffsets[c.m_nFrom]; !flips && j < adjacencyOffsets[c.m_nFrom + 1]; ++j) {
+                auto t = adjacency[j];
+                unsigned int triangle[3];
+                bool shared = false;
+                for(auto k = 0u; k < 3; ++k) {
+                    triangle[k] = remap[m_Indices[3 * t + k]];
+                    shared = shared || triangle[k] == c.m_nTo;
+                }
+                if(shared) {
+                    ++sharedCount;
+                    continue;
+                }
+                glm::vec3 p[3], q[3];
+                for(auto k = 0u; k < 3; ++k) {
+                    p[k] = m_Positions[triangle[k]];
+                    q[k] = triangle[k] == c.m_nFrom ? m_Positions[c.m_nTo] : p[k];
+                }
+                auto n0 = glm::cross(p[1] - p[0], p[2] - p[0]);
+                auto n1 = glm::cross(q[1] - q[0], q[2] - q[0]);
+                flips = glm::dot(n0, n1) <= 1e-2f * glm::length(n0) * glm::length(n1);
+            }
+            if(flips) {
+                continue;
+            }
+
+            remap[c.m_nFrom] = c.m_nTo;
+            m_Quadrics[c.m_nTo] += m_Quadrics[c.m_nFrom];
+            touched[c.m_nFrom] = touched[c.m_nTo] = true;
+            m_Error = std::max(m_Error, c.m_Cost);
+            removedCount += sharedCount;
+            ++collapseCount;
+        }
+        if(!collapseCount) {
+            return false;
+        }
+
+        size_t indexCount = 0;
+        for(size_t i = 0; i < m_Indices.size(); i += 3) {
+            auto a = remap[m_Indices[i]], b = remap[m_Indices[i + 1]], c = remap[m_Indices[i + 2]];
+            if(a != b && b != c && c != a) {
+                m_Indices[indexCount++] = a;
+                m_Indices[indexCount++] = b;
+                m_Indices[indexCount++] = c;
+            }
+        }
+        m_Indices.resize(indexCount);
+        return true;
+    }
+
+    unsigned int m_nFirst; // First vertex of the mesh, the others are relative to it
+    std::vector<glm::vec3> m_Positions;
+    std::vector<unsigned int> m_Indices;
+    std::vector<Quadric> m_Quadrics;
+    std::vector<bool> m_Locked;
+    double m_Error; // Largest cost of a collapse so far
+};
+
+}
+
+void Geometry::buildLods(const std::vector<float>& ratios, float maxError) {
+    m_LodBuffer.clear();
+    m_LodIndexBuffer.clear();
+    buildLods(0, ratios, maxError);
+}
+
+void Geometry::buildLods(size_t meshOffset, const std::vector<float>& ratios, float maxError) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::vector<Lod>> meshLods(m_MeshBuffer.size() - meshOffset);
+    std::vector<std::vector<unsigned int>> meshIndices(meshLods.size());
+    parallelFor(meshLods.size(), [&](size_t i) {
+        const auto& mesh = m_MeshBuffer[meshOffset + i];
+        auto pIndices = m_IndexBuffer.data() + mesh.m_nIndexOffset;
+        if(mesh.m_nIndexCount < 3) {
+            return;
+        }
+        BBox3f bbox(m_VertexBuffer[pIndices[0]].m_Position);
+        for(auto j = 1u; j < mesh.m_nIndexCount; ++j) {
+            bbox.grow(m_VertexBuffer[pIndices[j]].m_Position);
+        }
+        auto errorBound = maxError * glm::length(bbox.size());
+
+        // Each level starts from the previous one
+        MeshSimplifier simplifier(m_VertexBuffer.data(), pIndices, mesh.m_nIndexCount);
+        auto triangleCount = simplifier.getTriangleCount();
+        auto previousCount = triangleCount;
+        for(auto ratio: ratios) {
+            auto targetCount = size_t(ratio * triangleCount);
+            if(targetCount >= previousCount) {
+                continue;
+            }
+            auto error = simplifier.simplify(targetCount, errorBound);
+            // Stuck at the error bound
+            if(!simplifier.getTriangleCount() || simplifier.getTriangleCount() > previousCount * 19 / 20) {
+                break;
+            }
+            Lod lod;
+            lod.m_nIndexOffset = meshIndices[i].size();
+            simplifier.getIndices(meshIndices[i]);
+            lod.m_nIndexCount = meshIndices[i].size() - lod.m_nIndexOffset;
+            lod.m_Error = error;
+            meshLods[i].push_back(lod);
+            previousCount = simplifier.getTriangleCount();
+        }
+    });
+
+    auto lodOffset = m_LodBuffer.size();
+    size_t triangleCount = 0, coarsestCount = 0;
+    for(auto i = 0u; i < meshLods.size(); ++i) {
+        auto& mesh = m_MeshBuffer[meshOffset + i];
+        unsigned int indexOffset = m_LodIndexBuffer.size();
+        mesh.m_nLodOffset = m_LodBuffer.size();
+        mesh.m_nLodCount = meshLods[i].size();
+        for(auto& lod: meshLods[i]) {
+            lod.m_nIndexOffset += indexOffset;
+            m_LodBuffer.push_back(lod);
+        }
+        m_LodIndexBuffer.insert(m_LodIndexBuffer.end(), meshIndices[i].begin(), meshIndices[i].end());
+        triangleCount += mesh.m_nIndexCount / 3;
+        coarsestCount += (meshLods[i].empty() ? mesh.m_nIndexCount : meshLods[i].back().m_nIndexCount) / 3;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::clog << "Build LODs (" << m_LodBuffer.size() - lodOffset << " levels, " << triangleCount << " -> "
+              << coarsestCount << " triangles at the coarsest levels, " << elapsed.count() << " s)." << std::endl;
+}
 
-        m_VertexBuffer[i1].m_Normal = n;
-        m_VertexBuffer[i2].m_Normal = n;
-        m_VertexBuffer[i3].m_Normal = n;
+unsigned int Geometry::selectLod(unsigned int meshIndex, const BBox3f& bbox, float projectedSize,
+                                 float maxPixelError) const {
+    const auto& mesh = m_MeshBuffer[meshIndex];
+    float diagonal = glm::length(bbox.size());
+    if(diagonal <= 0.f) {
+        return 0;
+    }
+    float pixelsPerUnit = projectedSize / diagonal;
+    unsigned int level = 0;
+    while(level < mesh.m_nLodCount && m_LodBuffer[mesh.m_nLodOffset + level].m_Error * pixelsPerUnit <= maxPixelError) {
+        ++level;
     }
+    return level;
 }
 
-bool Geometry::loadOBJ(const FilePath& filepath, const FilePath& mtlBasePath, bool loadTextures) {
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
+namespace {
 
-    std::clog << "Load OBJ " << filepath << std::endl;
-    std::string objErr = tinyobj::LoadObj(shapes, materials,
-        filepath.c_str(), mtlBasePath.c_str());
+// Vertex 'i' of the OBJ attribute pools, missing attributes are zero
+Geometry::Vertex makeVertex(const tinyobj::vertex_index& i,
+                            const std::vector<float>& v, const std::vector<float>& vn, const std::vector<float>& vt) {
+    Geometry::Vertex vertex;
+    vertex.m_Position = glm::vec3(v[3 * i.v_idx], v[3 * i.v_idx + 1], v[3 * i.v_idx + 2]);
+    if(i.vn_idx >= 0) {
+        vertex.m_Normal = glm::vec3(vn[3 * i.vn_idx], vn[3 * i.vn_idx + 1], vn[3 * i.vn_idx + 2]);
+    } else {
+        vertex.m_Normal = glm::vec3(0.f);
+    }
+    if(i.vt_idx >= 0) {
+        vertex.m_TexCoords = glm::vec2(vt[2 * i.vt_idx], vt[2 * i.vt_idx + 1]);
+    } else {
+        vertex.m_TexCoords = glm::vec2(0.f);
+    }
+    return vertex;
+}
 
-    std::clog << "done." << std::endl;
+// tinyobj prepends the base path as is, and FilePath drops the trailing separator
+std::string mtlPrefix(const FilePath& mtlBasePath) {
+    return mtlBasePath.empty() ? std::string() : mtlBasePath.str() + FilePath::PATH_SEPARATOR;
+}
 
-    if (!objErr.empty()) {
-        std::cerr << objErr << std::endl;
-        return false;
+Geometry::Material convertMaterial(const tinyobj::material_t& material, const FilePath& mtlBasePath) {
+    Geometry::Material m;
+    m.m_Ka = glm::vec3(material.ambient[0], material.ambient[1], material.ambient[2]);
+    m.m_Kd = glm::vec3(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
+    m.m_Ks = glm::vec3(material.specular[0], material.specular[1], material.specular[2]);
+    m.m_Tr = glm::vec3(material.transmittance[0], material.transmittance[1], material.transmittance[2]);
+    m.m_Le = glm::vec3(material.emission[0], material.emission[1], material.emission[2]);
+    m.m_Shininess = material.shininess;
+    m.m_RefractionIndex = material.ior;
+    m.m_Dissolve = material.dissolve;
+
+    if(!material.ambient_texname.empty()) {
+        m.m_KaMapPath = mtlBasePath + material.ambient_texname;
+    }
+    if(!material.diffuse_texname.empty()) {
+        m.m_KdMapPath = mtlBasePath + material.diffuse_texname;
+    }
+    if(!material.specular_texname.empty()) {
+        m.m_KsMapPath = mtlBasePath + material.specular_texname;
     }
+    if(!material.normal_texname.empty()) {
+        m.m_NormalMapPath = mtlBasePath + material.normal_texname;
+    }
+    return m;
+}
 
-    std::clog << "Load materials" << std::endl;
-    m_Materials.reserve(m_Materials.size() + materials.size());
-    for(auto& material: materials) {
-        m_Materials.emplace_back();
-        auto& m = m_Materials.back();
+// Receives the faces from the OBJ parser and writes deduplicated vertices and
+// final indices straight into the geometry buffers, one mesh per material of
+// each shape.
+class GeometryBuilder: public tinyobj::ShapeBuilder {
+public:
+    GeometryBuilder(std::vector<Geometry::Vertex>& vertices, std::vector<unsigned int>& indices,
+                    std::vector<Geometry::Mesh>& meshes, Geometry::LoadProgress* pProgress):
+        m_Vertices(vertices), m_Indices(indices), m_Meshes(meshes), m_pProgress(pProgress) {
+        beginShape();
+    }
+
+    virtual void reserve(size_t vertexCount, size_t normalCount, size_t texcoordCount, size_t faceCount) {
+        // Every position is used at least once, every face gives at least a triangle
+        m_Vertices.reserve(m_Vertices.size() + std::max(vertexCount, std::max(normalCount, texcoordCount)));
+        m_Indices.reserve(m_Indices.size() + 3 * faceCount);
+    }
+
+    virtual void faceGroup(const std::string& name, int materialId,
+                           const tinyobj::vertex_index* indices, const unsigned int* faceSizes, size_t faceCount,
+                           const std::vector<float>& v, const std::vector<float>& vn, const std::vector<float>& vt) {
+        m_sName = name;
+        // Sort key of the triangles of the group, 0 for no material
+        unsigned int bucket = materialId >= 0 ? materialId + 1 : 0;
+        m_nBucketCount = std::max(m_nBucketCount, bucket + 1);
 
-        m.m_Ka = glm::vec3(material.ambient[0], material.ambient[1], material.ambient[2]);
-        m.m_Kd = glm::vec3(material.diffuse[0], material.diffuse[1], material.diffuse[2]);
-        m.m_Ks = glm::vec3(material.specular[0], material.specular[1], material.specular[2]);
-        m.m_Tr = glm::vec3(material.transmittance[0], material.transmittance[1], material.transmittance[2]);
-        m.m_Le = glm::vec3(material.emission[0], material.emission[1], material.emission[2]);
-        m.m_Shininess = material.shininess;
-        m.m_RefractionIndex = material.ior;
-        m.m_Dissolve = material.dissolve;
+        for(size_t i = 0; i < faceCount; ++i) {
+            const tinyobj::vertex_index* face = indices;
+            indices += faceSizes[i];
 
-        if(loadTextures) {
-            if(!material.ambient_texname.empty()) {
-                //std::replace(material.ambient_texname.begin(), material.ambient_texname.end(), '\\', '/');
-                FilePath texturePath = mtlBasePath + material.ambient_texname;
-                std::clog << "load " << texturePath << std::endl;
-                m.m_pKaMap = ImageManager::loadImage(texturePath);
+            // Polygon -> triangle fan
+            for(size_t k = 2; k < faceSizes[i]; ++k) {
+                m_Indices.push_back(addVertex(face[0], v, vn, vt));
+                m_Indices.push_back(addVertex(face[k - 1], v, vn, vt));
+                m_Indices.push_back(addVertex(face[k], v, vn, vt));
+                m_TriangleBuckets.push_back(bucket);
             }
+        }
+    }
 
-            if(!material.diffuse_texname.empty()) {
-                //std::replace(material.diffuse_texname.begin(), material.diffuse_texname.end(), '\\', '/');
-                FilePath texturePath = mtlBasePath + material.diffuse_texname;
-                std::clog << "load " << texturePath << std::endl;
-                m.m_pKdMap = ImageManager::loadImage(texturePath);
+    virtual void endShape() {
+        if(m_Indices.size() > m_nIndexOffset) {
+            sortTrianglesByMaterial();
+            if(!m_bHasNormals) {
+                // Before the next shape, so that the vertices split at creases
+                // stay in the range of this one
+                computeSmoothNormals(m_Vertices, m_Indices, m_nIndexOffset, m_Indices.size() - m_nIndexOffset,
+                                     Geometry::DEFAULT_CREASE_ANGLE);
             }
 
-            if(!material.specular_texname.empty()) {
-                //std::replace(material.specular_texname.begin(), material.specular_texname.end(), '\\', '/');
-                FilePath texturePath = mtlBasePath + material.specular_texname;
-                std::clog << "load " << texturePath << std::endl;
-                m.m_pKsMap = ImageManager::loadImage(texturePath);
+            auto indexOffset = m_nIndexOffset;
+            for(auto bucket = 0u; bucket < m_nBucketCount; ++bucket) {
+                auto indexCount = 3 * m_BucketSizes[bucket];
+                if(!indexCount) {
+                    continue;
+                }
+                int materialIndex = int(bucket) - 1; // Material of the file, remapped once they are loaded
+                m_Meshes.emplace_back(m_sName, indexOffset, indexCount, materialIndex);
+                indexOffset += indexCount;
             }
+        }
+        beginShape();
+    }
+
+    virtual bool progress(size_t bytesParsed, size_t totalBytes) {
+        if(!m_pProgress) {
+            return true;
+        }
+        m_pProgress->m_nTotalBytes = totalBytes;
+        m_pProgress->m_nParsedBytes = bytesParsed;
+        return !m_pProgress->m_bCancelled;
+    }
+
+private:
+    void beginShape() {
+        m_nIndexOffset = m_Indices.size();
+        m_nBucketCount = 1;
+        m_TriangleBuckets.clear();
+        m_bHasNormals = false;
+        m_VertexCache.clear();
+    }
+
+    // Stable counting sort of the triangles of the shape by material, linear
+    // in the number of triangles and materials. Fills m_BucketSizes.
+    void sortTrianglesByMaterial() {
+        m_BucketSizes.assign(m_nBucketCount, 0);
+        for(auto bucket: m_TriangleBuckets) {
+            ++m_BucketSizes[bucket];
+        }
+        if(*std::max_element(m_BucketSizes.begin(), m_BucketSizes.end()) == m_TriangleBuckets.size()) {
+            return; // Single material, already sorted
+        }
+
+        m_BucketOffsets.resize(m_nBucketCount);
+        size_t offset = 0;
+        for(auto bucket = 0u; bucket < m_nBucketCount; ++bucket) {
+            m_BucketOffsets[bucket] = offset;
+            offset += 3 * m_BucketSizes[bucket];
+        }
+
+        auto pIndices = m_Indices.data() + m_nIndexOffset;
+        m_SortedIndices.resize(3 * m_TriangleBuckets.size());
+        for(size_t i = 0; i < m_TriangleBuckets.size(); ++i) {
+            auto& dst = m_BucketOffsets[m_TriangleBuckets[i]];
+            m_SortedIndices[dst] = pIndices[3 * i];
+            m_SortedIndices[dst + 1] = pIndices[3 * i + 1];
+            m_SortedIndices[dst + 2] = pIndices[3 * i + 2];
+            dst += 3;
+        }
+        std::copy(m_SortedIndices.begin(), m_SortedIndices.end(), pIndices);
+    }
+
+    unsigned int addVertex(const tinyobj::vertex_index& i,
+                           const std::vector<float>& v, const std::vector<float>& vn, const std::vector<float>& vt) {
+        unsigned int index = m_Vertices.size();
+        unsigned int cached = m_VertexCache.findOrInsert(i, index);
+        if(cached != index) {
+            return cached;
+        }
+
+        m_Vertices.push_back(makeVertex(i, v, vn, vt));
+        m_bHasNormals = m_bHasNormals || i.vn_idx >= 0;
+        return index;
+    }
+
+    std::vector<Geometry::Vertex>& m_Vertices;
+    std::vector<unsigned int>& m_Indices;
+    std::vector<Geometry::Mesh>& m_Meshes;
+    Geometry::LoadProgress* m_pProgress;
+
+    tinyobj::VertexCache m_VertexCache; // Shared by the face groups of the current shape
+    std::string m_sName;
+    unsigned int m_nIndexOffset;
+    unsigned int m_nBucketCount;
+    std::vector<unsigned int> m_TriangleBuckets; // Material bucket of each triangle of the shape
+    std::vector<size_t> m_BucketSizes;
+    std::vector<size_t> m_BucketOffsets;
+    std::vector<unsigned int> m_SortedIndices;
+    bool m_bHasNormals;
+};
+
+// Receives the faces from the OBJ parser and hands them over in chunks of
+// bounded size, each with its own vertices.
+class StreamingBuilder: public tinyobj::ShapeBuilder {
+public:
+    StreamingBuilder(const std::function<bool (const Geometry::MeshChunk&)>& onChunk,
+                     size_t maxChunkTriangles, int materialOffset):
+        m_OnChunk(onChunk), m_nMaxChunkIndices(3 * maxChunkTriangles), m_nMaterialOffset(materialOffset),
+        m_nMaterialIndex(-1), m_bHasNormals(false), m_bStopped(false) {
+        m_Vertices.reserve(m_nMaxChunkIndices);
+        m_Indices.reserve(m_nMaxChunkIndices);
+        m_VertexCache.reserve(m_nMaxChunkIndices);
+    }
+
+    // True if onChunk asked to stop
+    bool isStopped() const {
+        return m_bStopped;
+    }
+
+    virtual void faceGroup(const std::string& name, int materialId,
+                           const tinyobj::vertex_index* indices, const unsigned int* faceSizes, size_t faceCount,
+                           const std::vector<float>& v, const std::vector<float>& vn, const std::vector<float>& vt) {
+        int materialIndex = materialId >= 0 ? m_nMaterialOffset + materialId : -1;
+        if(materialIndex != m_nMaterialIndex) {
+            flush(true);
+        }
+        m_sName = name;
+        m_nMaterialIndex = materialIndex;
+
+        for(size_t i = 0; i < faceCount && !m_bStopped; ++i) {
+            const tinyobj::vertex_index* face = indices;
+            indices += faceSizes[i];
 
-            if(!material.normal_texname.empty()) {
-                //std::replace(material.normal_texname.begin(), material.normal_texname.end(), '\\', '/');
-                FilePath texturePath = mtlBasePath + material.normal_texname;
-                std::clog << "load " << texturePath << std::endl;
-                m.m_pNormalMap = ImageManager::loadImage(texturePath);
+            // Polygon -> triangle fan
+            for(size_t k = 2; k < faceSizes[i]; ++k) {
+                if(m_Indices.size() >= m_nMaxChunkIndices) {
+                    flush(false);
+                }
+                m_Indices.push_back(addVertex(face[0], v, vn, vt));
+                m_Indices.push_back(addVertex(face[k - 1], v, vn, vt));
+                m_Indices.push_back(addVertex(face[k], v, vn, vt));
             }
         }
     }
-    std::clog << "done." << std::endl;
+
+    virtual void endShape() {
+        flush(true);
+    }
+
+    virtual bool progress(size_t, size_t) {
+        return !m_bStopped;
+    }
+
+private:
+    void flush(bool endOfMesh) {
+        if(m_Indices.empty() || m_bStopped) {
+            return;
+        }
+        if(!m_bHasNormals) {
+            computeSmoothNormals(m_Vertices, m_Indices, 0, m_Indices.size(), Geometry::DEFAULT_CREASE_ANGLE);
+        }
+
+        Geometry::MeshChunk chunk;
+        chunk.m_sName = m_sName;
+        chunk.m_nMaterialIndex = m_nMaterialIndex;
+        chunk.m_pVertices = m_Vertices.data();
+        chunk.m_nVertexCount = m_Vertices.size();
+        chunk.m_pIndices = m_Indices.data();
+        chunk.m_nIndexCount = m_Indices.size();
+        chunk.m_bEndOfMesh = endOfMesh;
+        m_bStopped = !m_OnChunk(chunk);
+
+        m_Vertices.clear();
+        m_Indices.clear();
+        m_VertexCache.clear();
+        m_bHasNormals = false;
+    }
+
+    unsigned int addVertex(const tinyobj::vertex_index& i,
+                           const std::vector<float>& v, const std::vector<float>& vn, const std::vector<float>& vt) {
+        unsigned int index = m_Vertices.size();
+        unsigned int cached = m_VertexCache.findOrInsert(i, index);
+        if(cached != index) {
+            return cached;
+        }
+        m_Vertices.push_back(makeVertex(i, v, vn, vt));
+        m_bHasNormals = m_bHasNormals || i.vn_idx >= 0;
+        return index;
+    }
+
+    const std::function<bool (const Geometry::MeshChunk&)>& m_OnChunk;
+    size_t m_nMaxChunkIndices;
+    int m_nMaterialOffset;
+
+    std::vector<Geometry::Vertex> m_Vertices;
+    std::vector<unsigned int> m_Indices;
+    tinyobj::VertexCache m_VertexCache; // Cleared with each chunk, so that chunks are self-contained
+    std::string m_sName;
+    int m_nMaterialIndex;
+    bool m_bHasNormals;
+    bool m_bStopped;
+};
+
+}
+
+size_t peakResidentSetSize() {
+#ifdef __linux__
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line)) {
+        if(line.compare(0, 6, "VmHWM:") == 0) {
+            return std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+        }
+    }
+#endif
+    return 0;
+}
+
+bool Geometry::parseOBJ(const FilePath& filepath, const FilePath& mtlBasePath, LoadProgress* pProgress,
+                        std::vector<int>& materialIndices, std::vector<std::string>& mtlPaths) {
+    std::vector<tinyobj::material_t> materials;
 
     auto globalVertexOffset = m_VertexBuffer.size();
     auto globalIndexOffset = m_IndexBuffer.size();
+    auto globalMeshOffset = m_MeshBuffer.size();
+
+    std::clog << "Load OBJ " << filepath << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    GeometryBuilder builder(m_VertexBuffer, m_IndexBuffer, m_MeshBuffer, pProgress);
+    std::string objErr = tinyobj::LoadObjParallel(builder, materials,
+        filepath.c_str(), mtlPrefix(mtlBasePath).c_str(), 0, &mtlPaths);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
 
-    auto nbVertex = 0u;
-    auto nbIndex = 0u;
-    for (const auto& shape: shapes) {
-        nbVertex += shape.mesh.positions.size();
-        nbIndex += shape.mesh.indices.size();
+    std::ifstream objFile(filepath.c_str(), std::ios::binary | std::ios::ate);
+    double megaBytes = objFile ? double(objFile.tellg()) / (1024. * 1024.) : 0.;
+    std::clog << "done (" << megaBytes << " MB in " << elapsed.count() << " s, "
+              << megaBytes / std::max(elapsed.count(), 1e-9) << " MB/s, peak RSS "
+              << peakResidentSetSize() / (1024. * 1024.) << " MB)." << std::endl;
+
+    if (!objErr.empty()) {
+        if(pProgress && pProgress->m_bCancelled) {
+            std::clog << "Load cancelled." << std::endl;
+        } else {
+            std::cerr << objErr << std::endl;
+        }
+        return false;
+    }
+
+    std::clog << "Load materials" << std::endl;
+    materialIndices.clear();
+    for(auto& material: materials) {
+        materialIndices.push_back(addMaterial(convertMaterial(material, mtlBasePath)));
+    }
+    for(auto i = globalMeshOffset; i < m_MeshBuffer.size(); ++i) {
+        auto& mesh = m_MeshBuffer[i];
+        if(mesh.m_nMaterialIndex >= 0) {
+            mesh.m_nMaterialIndex = materialIndices[mesh.m_nMaterialIndex];
+        }
     }
+    std::clog << "done." << std::endl;
 
-    std::clog << "Number of meshes: " << shapes.size() << std::endl;
-    std::clog << "Number of vertices: " << nbVertex << std::endl;
-    std::clog << "Number of triangles: " << (nbIndex) / 3 << std::endl;
+    std::clog << "Number of meshes: " << m_MeshBuffer.size() - globalMeshOffset << std::endl;
+    std::clog << "Number of vertices: " << m_VertexBuffer.size() - globalVertexOffset << std::endl;
+    std::clog << "Number of triangles: " << (m_IndexBuffer.size() - globalIndexOffset) / 3 << std::endl;
 
-    m_BBox = BBox3f(glm::vec3(shapes[0].mesh.positions[0], shapes[0].mesh.positions[1], shapes[0].mesh.positions[2]));
+    // Bounds of this file only, merged with the rest by loadOBJ
+    m_BBox = BBox3f(glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()));
+    for(auto i = globalVertexOffset; i < m_VertexBuffer.size(); ++i) {
+        m_BBox.grow(m_VertexBuffer[i].m_Position);
+    }
+
+    return true;
+}
 
-    m_VertexBuffer.resize(m_VertexBuffer.size() + nbVertex);
-    m_IndexBuffer.resize(m_IndexBuffer.size() + nbIndex);
+bool Geometry::streamOBJ(const FilePath& filepath, const FilePath& mtlBasePath,
+                         const std::function<bool (const MeshChunk&)>& onChunk,
+                         std::vector<Material>& materials, const StreamOptions& options) {
+    // Half of the budget for the chunk, in the worst case of 3 new vertices
+    // per triangle with their index and vertex cache slots, half for the file.
+    // The vertex cache stays at most half full: 2 slots per vertex.
+    const size_t triangleSize = 3 * (sizeof(Vertex) + sizeof(unsigned int) + 2 * tinyobj::VertexCache::slotBytes());
+    size_t maxChunkTriangles = std::max<size_t>(1, std::min<size_t>(options.m_nMaxChunkTriangles,
+                                                                    options.m_nMemoryCeiling / 2 / triangleSize));
 
-    auto pVertex = (Vertex*) m_VertexBuffer.data() + globalVertexOffset;
-    auto pIndex = (unsigned int*) m_IndexBuffer.data() + globalIndexOffset;
+    std::clog << "Stream OBJ " << filepath << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<tinyobj::material_t> objMaterials;
+    StreamingBuilder builder(onChunk, maxChunkTriangles, materials.size());
+    std::string objErr = tinyobj::LoadObjMapped(builder, objMaterials, filepath.c_str(),
+        mtlPrefix(mtlBasePath).c_str(), std::max<size_t>(1, options.m_nMemoryCeiling / 2));
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
 
-    m_MeshBuffer.reserve(m_MeshBuffer.size() + shapes.size());
+    std::clog << "done (" << elapsed.count() << " s, peak RSS "
+              << peakResidentSetSize() / (1024. * 1024.) << " MB)." << std::endl;
 
-    auto vertexOffset = globalVertexOffset;
-    auto indexOffset = globalIndexOffset;
-    for (size_t i = 0; i < shapes.size(); i++) {
-        auto pVertexTmp = pVertex;
-        for (auto j = 0u; j < shapes[i].mesh.positions.size(); j += 3) {
-            pVertexTmp->m_Position.x = shapes[i].mesh.positions[j];
-            pVertexTmp->m_Position.y = shapes[i].mesh.positions[j + 1];
-            pVertexTmp->m_Position.z = shapes[i].mesh.positions[j + 2];
+    if(!objErr.empty()) {
+        if(builder.isStopped()) {
+            std::clog << "Stream stopped." << std::endl;
+        } else {
+            std::cerr << objErr << std::endl;
+        }
+        return false;
+    }
 
-            m_BBox.grow(pVertexTmp->m_Position);
+    for(auto& material: objMaterials) {
+        materials.push_back(convertMaterial(material, mtlBasePath));
+    }
+    return true;
+}
 
-            ++pVertexTmp;
+bool Geometry::loadMaterialTextures(const Material* pMaterial, LoadProgress* pProgress) {
+    const Image* maps[4] = { nullptr, nullptr, nullptr, nullptr };
+    const FilePath* paths[4] = {
+        &pMaterial->m_KaMapPath, &pMaterial->m_KdMapPath, &pMaterial->m_KsMapPath, &pMaterial->m_NormalMapPath
+    };
+    for(auto i = 0u; i < 4; ++i) {
+        if(paths[i]->empty()) {
+            continue;
+        }
+        if(pProgress && pProgress->m_bCancelled) {
+            return false;
         }
-        pVertexTmp = pVertex;
-        if(shapes[i].mesh.normals.size()) {
-            for (auto j = 0u; j < shapes[i].mesh.normals.size(); j += 3) {
-                pVertexTmp->m_Normal.x = shapes[i].mesh.normals[j];
-                pVertexTmp->m_Normal.y = shapes[i].mesh.normals[j + 1];
-                pVertexTmp->m_Normal.z = shapes[i].mesh.normals[j + 2];
-                ++pVertexTmp;
+        std::clog << "load " << *paths[i] << std::endl;
+        maps[i] = ImageManager::loadImage(*paths[i]);
+        if(pProgress) {
+            ++pProgress->m_nDecodedTextures;
+        }
+    }
+    MaterialManager::setTextureMaps(pMaterial, maps[0], maps[1], maps[2], maps[3]);
+    return true;
+}
+
+int Geometry::addMaterial(const Material& material) {
+    auto pMaterial = MaterialManager::intern(material);
+    auto it = m_MaterialIndices.find(pMaterial);
+    if(it != std::end(m_MaterialIndices)) {
+        return (*it).second;
+    }
+    m_Materials.push_back(pMaterial);
+    return m_MaterialIndices[pMaterial] = m_Materials.size() - 1;
+}
+
+void Geometry::truncate(size_t vertexOffset, size_t indexOffset, size_t meshOffset, size_t materialOffset) {
+    m_VertexBuffer.resize(vertexOffset);
+    m_PositionBuffer.resize(std::min(m_PositionBuffer.size(), vertexOffset));
+    m_TangentBuffer.resize(std::min(m_TangentBuffer.size(), vertexOffset));
+    m_PackedVertexBuffer.resize(std::min(m_PackedVertexBuffer.size(), vertexOffset));
+    m_IndexBuffer.resize(indexOffset);
+    m_ShortIndexBuffer.resize(std::min(m_ShortIndexBuffer.size(), indexOffset));
+    m_MeshBuffer.erase(m_MeshBuffer.begin() + meshOffset, m_MeshBuffer.end());
+    m_PackingBoxes.resize(std::min(m_PackingBoxes.size(), meshOffset));
+    m_MeshBounds.resize(std::min(m_MeshBounds.size(), meshOffset));
+    for(auto i = materialOffset; i < m_Materials.size(); ++i) {
+        m_MaterialIndices.erase(m_Materials[i]);
+    }
+    m_Materials.erase(m_Materials.begin() + materialOffset, m_Materials.end());
+}
+
+bool Geometry::loadOBJ(const FilePath& filepath, const FilePath& mtlBasePath, unsigned int options,
+                       LoadProgress* pProgress) {
+    // The vertices of the geometry after releaseVertexBuffer, released again
+    // if the load fails
+    bool unpacked = m_VertexBuffer.empty() && !m_PackedVertexBuffer.empty();
+    if(unpacked) {
+        unpackVertices();
+    }
+    auto vertexOffset = m_VertexBuffer.size();
+    auto indexOffset = m_IndexBuffer.size();
+    auto meshOffset = m_MeshBuffer.size();
+    auto materialOffset = m_Materials.size();
+    auto bbox = m_BBox;
+
+    std::vector<int> materialIndices;
+    auto cachePath = filepath.addExt(".gmesh");
+    std::vector<std::string> mtlPaths;
+    if(!loadCache(cachePath, filepath, mtlBasePath, options, pProgress, materialIndices)) {
+        if(!parseOBJ(filepath, mtlBasePath, pProgress, materialIndices, mtlPaths)) {
+            truncate(vertexOffset, indexOffset, meshOffset, materialOffset);
+            m_BBox = bbox;
+            if(unpacked) {
+                releaseVertexBuffer();
             }
-        } else {
-            // should create normals from triangles...
+            return false;
+        }
+        if(options & WELD_VERTICES) {
+            weldVertices(vertexOffset, meshOffset, DEFAULT_WELD_POSITION_TOLERANCE, DEFAULT_WELD_NORMAL_ANGLE,
+                         DEFAULT_WELD_TEXCOORDS_TOLERANCE);
+        }
+        if(options & OPTIMIZE_VERTEX_CACHE) {
+            optimizeVertexCache(meshOffset, DEFAULT_VERTEX_CACHE_SIZE);
         }
-        pVertexTmp = pVertex;
-        if(shapes[i].mesh.texcoords.size()) {
-            for (auto j = 0u; j < shapes[i].mesh.texcoords.size(); j += 2) {
-                pVertexTmp->m_TexCoords.x = shapes[i].mesh.texcoords[j];
-                pVertexTmp->m_TexCoords.y = shapes[i].mesh.texcoords[j + 1];
-                ++pVertexTmp;
+        if(options & OPTIMIZE_VERTEX_FETCH) {
+            optimizeVertexFetch(vertexOffset, meshOffset);
+        }
+        saveCache(cachePath, filepath, mtlBasePath, mtlPaths, options, vertexOffset, indexOffset, meshOffset,
+                  materialIndices);
+    }
+    // Both give the bounds of the file alone
+    m_BBox = merge(bbox, m_BBox);
+    computeMeshBounds(meshOffset);
+
+    if(options & LOAD_TEXTURES) {
+        if(pProgress) {
+            for(auto i: materialIndices) {
+                const auto& m = *m_Materials[i];
+                pProgress->m_nTextureCount += !m.m_KaMapPath.empty() + !m.m_KdMapPath.empty() +
+                                              !m.m_KsMapPath.empty() + !m.m_NormalMapPath.empty();
             }
-        } else {
-            for (auto j = 0u; j < shapes[i].mesh.texcoords.size(); j += 2) {
-                pVertexTmp->m_TexCoords.x =  0.f;
-                pVertexTmp->m_TexCoords.x =  0.f;
-                ++pVertexTmp;
+        }
+        for(auto i: materialIndices) {
+            if(!loadMaterialTextures(m_Materials[i], pProgress)) {
+                std::clog << "Load cancelled." << std::endl;
+                truncate(vertexOffset, indexOffset, meshOffset, materialOffset);
+                m_BBox = bbox;
+                if(unpacked) {
+                    releaseVertexBuffer();
+                }
+                return false;
             }
         }
+    }
+
+    if(options & GENERATE_TANGENTS) {
+        generateTangents(indexOffset, m_IndexBuffer.size() - indexOffset);
+    } else if(!m_TangentBuffer.empty()) {
+        m_TangentBuffer.resize(m_VertexBuffer.size(), glm::vec4(0.f));
+    }
+    if((options & BUILD_POSITION_BUFFER) || !m_PositionBuffer.empty()) {
+        buildPositionBuffer(vertexOffset);
+    }
+    if(options & PACK_VERTICES) {
+        packVertices();
+    }
+    if(options & NARROW_INDICES) {
+        narrowIndices();
+    }
+    if(options & BUILD_LODS) {
+        buildLods(meshOffset, { .5f, .25f, .125f, .0625f }, .02f);
+    }
+    if(options & BUILD_MESHLETS) {
+        buildMeshlets(meshOffset, DEFAULT_MESHLET_VERTEX_COUNT, DEFAULT_MESHLET_TRIANGLE_COUNT);
+    }
+    if(options & RELEASE_VERTEX_BUFFER) {
+        releaseVertexBuffer();
+    }
+    return true;
+}
+
+// Binary cache (.gmesh) layout, native endianness:
+//   GMeshHeader
+//   uint32_t length, char mtlBasePath[length]
+//   mtlCount x { uint32_t length, char path[length] }
+//                                      the .mtl files read by the OBJ
+//   Vertex[vertexCount]
+//   uint64_t indexDataSize, indexData[indexDataSize]
+//                                      the indices relative to the first cached
+//                                      vertex, see Geometry::encodeIndices
+//   meshCount x { uint32_t nameLength, char name[nameLength],
+//                 uint32_t indexOffset, indexCount, int32_t materialIndex }
+//   materialCount x { GMeshMaterial, 4 x { uint32_t length, char path[length] } }
+// Index, mesh and material offsets are relative to what was appended by the
+// loadOBJ call that produced the cache, and are rebased when loading.
+namespace {
+
+const char GMESH_MAGIC[4] = { 'G', 'M', 'S', 'H' };
+const uint32_t GMESH_VERSION = 4;
+// Load options that change the cached geometry
+const uint32_t GMESH_OPTIONS = Geometry::WELD_VERTICES | Geometry::OPTIMIZE_VERTEX_CACHE |
+                               Geometry::OPTIMIZE_VERTEX_FETCH;
+
+struct GMeshHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t vertexSize;
+    uint32_t flags; // load options baked into the cache, among GMESH_OPTIONS
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint64_t sourceHash;
+    uint64_t mtlSize; // sum of the .mtl file sizes
+    int64_t mtlTime; // latest of their modification times
+    uint64_t mtlHash; // of their contents
+    uint64_t mtlCount;
+    uint64_t vertexCount;
+    uint64_t indexCount;
+    uint64_t meshCount;
+    uint64_t materialCount;
+    float bboxLower[3];
+    float bboxUpper[3];
+};
+
+struct GMeshMaterial {
+    float ka[3], kd[3], ks[3], tr[3], le[3];
+    float shininess;
+    float refractionIndex;
+    float dissolve;
+};
+
+bool fileStat(const FilePath& filepath, uint64_t& size, int64_t& time) {
+    struct stat st;
+    if(stat(filepath.c_str(), &st) != 0) {
+        return false;
+    }
+    size = st.st_size;
+    time = st.st_mtime;
+    return true;
+}
+
+// 64-bit content hash, one multiply per 8 bytes so that it stays I/O bound.
+uint64_t hashFile(const FilePath& filepath) {
+    tinyobj::MappedFile file(filepath.c_str());
+    const char* data = file.data();
+    if(!data) {
+        return 0;
+    }
+    size_t size = file.size();
+    uint64_t h = 0xcbf29ce484222325ull ^ size;
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        h = (h ^ word) * 0x100000001b3ull;
+        h ^= h >> 29;
+    }
+    for(; i < size; ++i) {
+        h = (h ^ (unsigned char) data[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+// Combined size and latest modification time of the files, missing ones
+// counting for nothing
+void filesStat(const std::vector<std::string>& paths, uint64_t& size, int64_t& time) {
+    size = 0;
+    time = 0;
+    for(const auto& path: paths) {
+        uint64_t fileSize;
+        int64_t fileTime;
+        if(fileStat(path, fileSize, fileTime)) {
+            size += fileSize;
+            time = std::max(time, fileTime);
+        }
+    }
+}
+
+uint64_t hashFiles(const std::vector<std::string>& paths) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for(const auto& path: paths) {
+        h = (h ^ hashFile(path)) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+void writeString(std::ostream& out, const std::string& str) {
+    uint32_t length = str.size();
+    out.write((const char*) &length, sizeof(length));
+    out.write(str.data(), length);
+}
+
+// Bounds-checked cursor over the mapped cache
+class CacheReader {
+public:
+    CacheReader(const char* data, size_t size): m_pData(data), m_pEnd(data + size) {
+    }
+
+    bool read(void* dst, size_t size) {
+        if(size_t(m_pEnd - m_pData) < size) {
+            return false;
+        }
+        std::memcpy(dst, m_pData, size);
+        m_pData += size;
+        return true;
+    }
+
+    // Returns the next size bytes, null if there are less
+    const char* skip(size_t size) {
+        if(size_t(m_pEnd - m_pData) < size) {
+            return nullptr;
+        }
+        auto data = m_pData;
+        m_pData += size;
+        return data;
+    }
 
-        for (auto j = 0u; j < shapes[i].mesh.indices.size(); ++j) {
-            pIndex[j] = vertexOffset + shapes[i].mesh.indices[j];
+    bool readString(std::string& str) {
+        uint32_t length;
+        if(!read(&length, sizeof(length)) || size_t(m_pEnd - m_pData) < length) {
+            return false;
         }
+        str.assign(m_pData, length);
+        m_pData += length;
+        return true;
+    }
+
+    bool atEnd() const {
+        return m_pData == m_pEnd;
+    }
+
+private:
+    const char* m_pData;
+    const char* m_pEnd;
+};
+
+}
+
+bool Geometry::loadCache(const FilePath& cachePath, const FilePath& filepath, const FilePath& mtlBasePath,
+                         unsigned int options, LoadProgress* pProgress, std::vector<int>& materialIndices) {
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if(!fileStat(filepath, sourceSize, sourceTime)) {
+        return false;
+    }
 
-        int materialIndex = -1;
-        if(!shapes[i].mesh.material_ids.empty()) {
-            materialIndex = shapes[i].mesh.material_ids[0];
+    auto start = std::chrono::steady_clock::now();
+    tinyobj::MappedFile file(cachePath.c_str());
+    if(!file.data()) {
+        return false;
+    }
+    CacheReader reader(file.data(), file.size());
+
+    GMeshHeader header;
+    if(!reader.read(&header, sizeof(header)) ||
+       std::memcmp(header.magic, GMESH_MAGIC, sizeof(GMESH_MAGIC)) != 0 ||
+       header.version != GMESH_VERSION ||
+       header.vertexSize != sizeof(Vertex) ||
+       header.flags != (options & GMESH_OPTIONS)) {
+        return false;
+    }
+
+    // The material paths of the cache are relative to the base path it was made with
+    std::string cachedMtlBasePath;
+    if(!reader.readString(cachedMtlBasePath) || cachedMtlBasePath != mtlBasePath.str() ||
+       header.mtlCount > file.size()) {
+        return false;
+    }
+    std::vector<std::string> mtlPaths(header.mtlCount);
+    for(auto& path: mtlPaths) {
+        if(!reader.readString(path)) {
+            return false;
         }
+    }
+    uint64_t mtlSize;
+    int64_t mtlTime;
+    filesStat(mtlPaths, mtlSize, mtlTime);
+
+    // Timestamps change on copies and checkouts: fall back to the content.
+    bool touched = header.sourceSize != sourceSize || header.sourceTime != sourceTime;
+    if(touched && (header.sourceSize != sourceSize || header.sourceHash != hashFile(filepath))) {
+        return false;
+    }
+    bool mtlTouched = header.mtlSize != mtlSize || header.mtlTime != mtlTime;
+    if(mtlTouched && (header.mtlSize != mtlSize || header.mtlHash != hashFiles(mtlPaths))) {
+        return false;
+    }
+
+    if(header.vertexCount > file.size() / sizeof(Vertex) || header.indexCount > file.size()) {
+        std::cerr << "Invalid geometry cache " << cachePath << std::endl;
+        return false;
+    }
+
+    auto vertexOffset = m_VertexBuffer.size();
+    auto indexOffset = m_IndexBuffer.size();
+    auto meshOffset = m_MeshBuffer.size();
+    auto materialOffset = m_Materials.size();
+
+    bool valid = true;
+    m_VertexBuffer.resize(vertexOffset + header.vertexCount);
+    valid = valid && reader.read(m_VertexBuffer.data() + vertexOffset, header.vertexCount * sizeof(Vertex));
+    m_IndexBuffer.resize(indexOffset + header.indexCount);
+    uint64_t indexDataSize = 0;
+    valid = valid && reader.read(&indexDataSize, sizeof(indexDataSize));
+    auto indexData = valid ? reader.skip(indexDataSize) : nullptr;
+    valid = indexData &&
+            decodeIndices((const unsigned char*) indexData, indexDataSize, m_IndexBuffer.data() + indexOffset,
+                          header.indexCount) == indexDataSize;
+    for(auto i = indexOffset; valid && i < m_IndexBuffer.size(); ++i) {
+        valid = m_IndexBuffer[i] < header.vertexCount;
+        m_IndexBuffer[i] += vertexOffset;
+    }
 
-        m_MeshBuffer.emplace_back(shapes[i].name, indexOffset, shapes[i].mesh.indices.size(), materialIndex);
+    for(auto i = 0u; valid && i < header.meshCount; ++i) {
+        std::string name;
+        uint32_t meshIndexOffset, meshIndexCount;
+        int32_t materialIndex;
+        valid = reader.readString(name) &&
+                reader.read(&meshIndexOffset, sizeof(meshIndexOffset)) &&
+                reader.read(&meshIndexCount, sizeof(meshIndexCount)) &&
+                reader.read(&materialIndex, sizeof(materialIndex)) &&
+                uint64_t(meshIndexOffset) + meshIndexCount <= header.indexCount &&
+                materialIndex < int64_t(header.materialCount);
+        if(valid) {
+            // Material of the file, remapped once they are loaded
+            m_MeshBuffer.emplace_back(std::move(name), indexOffset + meshIndexOffset, meshIndexCount,
+                                      materialIndex < 0 ? -1 : materialIndex);
+        }
+    }
 
-        if(shapes[i].mesh.normals.size() == 0u) {
-            generateNormals(m_MeshBuffer.size() - 1);
+    for(auto i = 0u; valid && i < header.materialCount; ++i) {
+        GMeshMaterial data;
+        std::string paths[4];
+        valid = reader.read(&data, sizeof(data)) &&
+                reader.readString(paths[0]) && reader.readString(paths[1]) &&
+                reader.readString(paths[2]) && reader.readString(paths[3]);
+        if(valid) {
+            Material m;
+            m.m_Ka = glm::vec3(data.ka[0], data.ka[1], data.ka[2]);
+            m.m_Kd = glm::vec3(data.kd[0], data.kd[1], data.kd[2]);
+            m.m_Ks = glm::vec3(data.ks[0], data.ks[1], data.ks[2]);
+            m.m_Tr = glm::vec3(data.tr[0], data.tr[1], data.tr[2]);
+            m.m_Le = glm::vec3(data.le[0], data.le[1], data.le[2]);
+            m.m_Shininess = data.shininess;
+            m.m_RefractionIndex = data.refractionIndex;
+            m.m_Dissolve = data.dissolve;
+            m.m_KaMapPath = paths[0];
+            m.m_KdMapPath = paths[1];
+            m.m_KsMapPath = paths[2];
+            m.m_NormalMapPath = paths[3];
+            materialIndices.push_back(addMaterial(m));
+        }
+    }
+    for(auto i = meshOffset; valid && i < m_MeshBuffer.size(); ++i) {
+        auto& mesh = m_MeshBuffer[i];
+        if(mesh.m_nMaterialIndex >= 0) {
+            mesh.m_nMaterialIndex = materialIndices[mesh.m_nMaterialIndex];
         }
+    }
+
+    if(!valid || !reader.atEnd()) {
+        std::cerr << "Invalid geometry cache " << cachePath << std::endl;
+        truncate(vertexOffset, indexOffset, meshOffset, materialOffset);
+        return false;
+    }
+
+    m_BBox = BBox3f(glm::vec3(header.bboxLower[0], header.bboxLower[1], header.bboxLower[2]),
+                    glm::vec3(header.bboxUpper[0], header.bboxUpper[1], header.bboxUpper[2]));
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    double megaBytes = file.size() / (1024. * 1024.);
+    std::clog << "Load cached geometry " << cachePath << " (" << megaBytes << " MB in " << elapsed.count() << " s, "
+              << megaBytes / std::max(elapsed.count(), 1e-9) << " MB/s)." << std::endl;
+
+    if(pProgress) {
+        pProgress->m_nTotalBytes = sourceSize;
+        pProgress->m_nParsedBytes = sourceSize;
+    }
 
-        pVertex += shapes[i].mesh.positions.size();
-        vertexOffset += shapes[i].mesh.positions.size();
-        pIndex += shapes[i].mesh.indices.size();
-        indexOffset += shapes[i].mesh.indices.size();
+    if(touched || mtlTouched) {
+        // Refresh the timestamps so that the next load skips the hashes
+        std::fstream out(cachePath.c_str(), std::ios::binary | std::ios::in | std::ios::out);
+        header.sourceTime = sourceTime;
+        header.mtlTime = mtlTime;
+        out.write((const char*) &header, sizeof(header));
     }
 
     return true;
 }
 
+void Geometry::saveCache(const FilePath& cachePath, const FilePath& filepath, const FilePath& mtlBasePath,
+                         const std::vector<std::string>& mtlPaths, unsigned int options,
+                         size_t vertexOffset, size_t indexOffset, size_t meshOffset,
+                         const std::vector<int>& materialIndices) const {
+    GMeshHeader header;
+    std::memcpy(header.magic, GMESH_MAGIC, sizeof(GMESH_MAGIC));
+    header.version = GMESH_VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.flags = options & GMESH_OPTIONS;
+    if(!fileStat(filepath, header.sourceSize, header.sourceTime)) {
+        return;
+    }
+    header.sourceHash = hashFile(filepath);
+    filesStat(mtlPaths, header.mtlSize, header.mtlTime);
+    header.mtlHash = hashFiles(mtlPaths);
+    header.mtlCount = mtlPaths.size();
+    header.vertexCount = m_VertexBuffer.size() - vertexOffset;
+    header.indexCount = m_IndexBuffer.size() - indexOffset;
+    header.meshCount = m_MeshBuffer.size() - meshOffset;
+    header.materialCount = materialIndices.size();
+    for(auto i = 0u; i < 3; ++i) {
+        header.bboxLower[i] = m_BBox.lower[i];
+        header.bboxUpper[i] = m_BBox.upper[i];
+    }
+
+    // Written next to the final file and renamed, so that a concurrent or
+    // interrupted run never sees a partial cache.
+    auto tmpPath = cachePath.addExt(".tmp");
+    {
+        std::ofstream out(tmpPath.c_str(), std::ios::binary);
+        if(!out) {
+            return;
+        }
+        out.write((const char*) &header, sizeof(header));
+        writeString(out, mtlBasePath.str());
+        for(const auto& path: mtlPaths) {
+            writeString(out, path);
+        }
+        out.write((const char*) (m_VertexBuffer.data() + vertexOffset), header.vertexCount * sizeof(Vertex));
+
+        std::vector<uint32_t> indices(m_IndexBuffer.begin() + indexOffset, m_IndexBuffer.end());
+        for(auto& index: indices) {
+            index -= vertexOffset;
+        }
+        std::vector<unsigned char> indexData;
+        indexData.reserve(indices.size() * 2);
+        encodeIndices(indices.data(), indices.size(), indexData);
+        uint64_t indexDataSize = indexData.size();
+        out.write((const char*) &indexDataSize, sizeof(indexDataSize));
+        out.write((const char*) indexData.data(), indexData.size());
+
+        for(auto i = meshOffset; i < m_MeshBuffer.size(); ++i) {
+            const auto& mesh = m_MeshBuffer[i];
+            uint32_t meshIndexOffset = mesh.m_nIndexOffset - indexOffset;
+            uint32_t meshIndexCount = mesh.m_nIndexCount;
+            int32_t materialIndex = -1;
+            if(mesh.m_nMaterialIndex >= 0) {
+                materialIndex = std::find(materialIndices.begin(), materialIndices.end(), mesh.m_nMaterialIndex) -
+                                materialIndices.begin();
+            }
+            writeString(out, mesh.m_sName);
+            out.write((const char*) &meshIndexOffset, sizeof(meshIndexOffset));
+            out.write((const char*) &meshIndexCount, sizeof(meshIndexCount));
+            out.write((const char*) &materialIndex, sizeof(materialIndex));
+        }
+
+        for(auto i: materialIndices) {
+            const auto& m = *m_Materials[i];
+            GMeshMaterial data;
+            for(auto j = 0u; j < 3; ++j) {
+                data.ka[j] = m.m_Ka[j];
+                data.kd[j] = m.m_Kd[j];
+                data.ks[j] = m.m_Ks[j];
+                data.tr[j] = m.m_Tr[j];
+                data.le[j] = m.m_Le[j];
+            }
+            data.shininess = m.m_Shininess;
+            data.refractionIndex = m.m_RefractionIndex;
+            data.dissolve = m.m_Dissolve;
+            out.write((const char*) &data, sizeof(data));
+            writeString(out, m.m_KaMapPath);
+            writeString(out, m.m_KdMapPath);
+            writeString(out, m.m_KsMapPath);
+            writeString(out, m.m_NormalMapPath);
+        }
+
+        if(!out) {
+            out.close();
+            std::remove(tmpPath.c_str());
+            return;
+        }
+    }
+    if(std::rename(tmpPath.c_str(), cachePath.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+    }
+}
+
+std::unordered_multimap<size_t, std::unique_ptr<Geometry::Material>> MaterialManager::m_MaterialMap;
+std::mutex MaterialManager::m_MaterialMapMutex;
+
+namespace {
+
+const auto MATERIAL_FACTOR_COUNT = 18u;
+
+void getMaterialFactors(const Geometry::Material& material, float* pFactors) {
+    const glm::vec3* colors[5] = { &material.m_Ka, &material.m_Kd, &material.m_Ks, &material.m_Tr, &material.m_Le };
+    for(auto i = 0u; i < 5; ++i) {
+        pFactors[3 * i] = colors[i]->x;
+        pFactors[3 * i + 1] = colors[i]->y;
+        pFactors[3 * i + 2] = colors[i]->z;
+    }
+    pFactors[15] = material.m_Shininess;
+    pFactors[16] = material.m_RefractionIndex;
+    pFactors[17] = material.m_Dissolve;
+}
+
+size_t hashMaterial(const Geometry::Material& material) {
+    float factors[MATERIAL_FACTOR_COUNT];
+    getMaterialFactors(material, factors);
+    size_t h = 0;
+    auto combine = [&h](size_t value) {
+        h ^= value + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    };
+    for(auto factor: factors) {
+        uint32_t bits;
+        std::memcpy(&bits, &factor, sizeof(bits));
+        combine(bits);
+    }
+    std::hash<FilePath> hashPath;
+    combine(hashPath(material.m_KaMapPath));
+    combine(hashPath(material.m_KdMapPath));
+    combine(hashPath(material.m_KsMapPath));
+    combine(hashPath(material.m_NormalMapPath));
+    return h;
+}
+
+bool sameMaterial(const Geometry::Material& a, const Geometry::Material& b) {
+    float factorsA[MATERIAL_FACTOR_COUNT], factorsB[MATERIAL_FACTOR_COUNT];
+    getMaterialFactors(a, factorsA);
+    getMaterialFactors(b, factorsB);
+    return std::equal(factorsA, factorsA + MATERIAL_FACTOR_COUNT, factorsB) &&
+           a.m_KaMapPath == b.m_KaMapPath && a.m_KdMapPath == b.m_KdMapPath &&
+           a.m_KsMapPath == b.m_KsMapPath && a.m_NormalMapPath == b.m_NormalMapPath;
+}
+
+}
+
+const Geometry::Material* MaterialManager::intern(const Geometry::Material& material) {
+    auto h = hashMaterial(material);
+    std::lock_guard<std::mutex> lock(m_MaterialMapMutex);
+    auto range = m_MaterialMap.equal_range(h);
+    for(auto it = range.first; it != range.second; ++it) {
+        if(sameMaterial(*(*it).second, material)) {
+            return (*it).second.get();
+        }
+    }
+    std::unique_ptr<Geometry::Material> pMaterial(new Geometry::Material(material));
+    pMaterial->m_pKaMap = pMaterial->m_pKdMap = pMaterial->m_pKsMap = pMaterial->m_pNormalMap = nullptr;
+    auto result = pMaterial.get();
+    m_MaterialMap.emplace(h, std::move(pMaterial));
+    return result;
+}
+
+void MaterialManager::setTextureMaps(const Geometry::Material* pMaterial, const Image* pKaMap, const Image* pKdMap,
+                                     const Image* pKsMap, const Image* pNormalMap) {
+    std::lock_guard<std::mutex> lock(m_MaterialMapMutex);
+    // Only this class hands out the materials, which it owns as non-const
+    auto pShared = const_cast<Geometry::Material*>(pMaterial);
+    pShared->m_pKaMap = pKaMap;
+    pShared->m_pKdMap = pKdMap;
+    pShared->m_pKsMap = pKsMap;
+    pShared->m_pNormalMap = pNormalMap;
+}
+
+GeometryLoadTask::GeometryLoadTask(const FilePath& filepath, const FilePath& mtlBasePath, unsigned int options):
+    m_Result(std::async(std::launch::async, [this, filepath, mtlBasePath, options]() {
+        std::unique_ptr<Geometry> pGeometry(new Geometry);
+        if(!pGeometry->loadOBJ(filepath, mtlBasePath, options, &m_Progress)) {
+            pGeometry.reset();
+        }
+        return pGeometry;
+    })) {
+}
+
+GeometryLoadTask::~GeometryLoadTask() {
+    cancel();
+    if(m_Result.valid()) {
+        m_Result.wait();
+    }
+}
+
+bool GeometryLoadTask::isReady() const {
+    return !m_Result.valid() || m_Result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+std::unique_ptr<Geometry> GeometryLoadTask::get() {
+    return m_Result.get();
+}
+
 }
@@ -0,0 +1,154 @@
+#include "glimac/GeometryBatch.hpp"
+#include "glimac/Parallel.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace glimac {
+
+unsigned int GeometryBatch::add(const Geometry& geometry, const glm::mat4& transform) {
+    Instance instance;
+    instance.m_Transform = transform;
+    instance.m_nVertexOffset = m_VertexBuffer.size();
+    instance.m_nVertexCount = geometry.getVertexCount();
+    instance.m_nMeshOffset = m_MeshSources.size();
+    instance.m_nMeshCount = geometry.getMeshCount();
+    auto instanceIndex = m_Instances.size();
+    m_Instances.push_back(instance);
+    m_bBuilt = false;
+
+    auto vertexOffset = m_VertexBuffer.size();
+    auto vertexCount = geometry.getVertexCount();
+    auto pVertices = geometry.getVertexBuffer();
+    auto pTangents = geometry.getTangentBuffer();
+    // After releaseVertexBuffer, the packed vertices unpacked in the box of
+    // their mesh; those of no mesh are left at zero
+    std::vector<Geometry::Vertex> unpacked;
+    if(!pVertices && vertexCount) {
+        unpacked.resize(vertexCount, Geometry::Vertex());
+        auto pPacked = geometry.getPackedVertexBuffer();
+        for(auto i = 0u; i < geometry.getMeshCount(); ++i) {
+            const auto& mesh = geometry.getMeshBuffer()[i];
+            const auto& box = geometry.getPackingBox(i);
+            for(auto j = mesh.m_nIndexOffset; j < mesh.m_nIndexOffset + mesh.m_nIndexCount; ++j) {
+                auto v = geometry.getIndexBuffer()[j];
+                unpacked[v] = Geometry::unpackVertex(pPacked[v], box);
+            }
+        }
+        pVertices = unpacked.data();
+    }
+    m_VertexBuffer.resize(vertexOffset + vertexCount);
+    if(pTangents || !m_TangentBuffer.empty()) {
+        m_TangentBuffer.resize(m_VertexBuffer.size(), glm::vec4(0.f));
+    }
+
+    glm::mat3 linear(transform);
+    glm::mat3 normalMatrix = glm::transpose(glm::inverse(linear));
+    bool mirror = glm::determinant(linear) < 0.f;
+    std::vector<BBox3f> blockBoxes;
+    const size_t blockSize = 1 << 14;
+    blockBoxes.resize((vertexCount + blockSize - 1) / blockSize);
+    parallelForRange(vertexCount, blockSize, [&](size_t begin, size_t end) {
+        BBox3f box(glm::vec3(transform * glm::vec4(pVertices[begin].m_Position, 1.f)));
+        for(auto i = begin; i < end; ++i) {
+            auto& vertex = m_VertexBuffer[vertexOffset + i];
+            vertex.m_Position = glm::vec3(transform * glm::vec4(pVertices[i].m_Position, 1.f));
+            auto normal = normalMatrix * pVertices[i].m_Normal;
+            float length = glm::length(normal);
+            vertex.m_Normal = length > 0.f ? normal / length : normal;
+            vertex.m_TexCoords = pVertices[i].m_TexCoords;
+            box.grow(vertex.m_Position);
+            if(pTangents) {
+                auto tangent = linear * glm::vec3(pTangents[i]);
+                length = glm::length(tangent);
+                // A mirror flips the bitangent, cross(normal, tangent) of the result
+                m_TangentBuffer[vertexOffset + i] = glm::vec4(length > 0.f ? tangent / length : tangent,
+                                                              mirror ? -pTangents[i].w : pTangents[i].w);
+            }
+        }
+        blockBoxes[begin / blockSize] = box;
+    });
+    for(const auto& box: blockBoxes) {
+        m_BBox.grow(box);
+    }
+
+    // Triangles are appended in the order of the meshes, build sorts them
+    auto pIndices = geometry.getIndexBuffer();
+    for(auto i = 0u; i < geometry.getMeshCount(); ++i) {
+        const auto& mesh = geometry.getMeshBuffer()[i];
+        MeshSource source;
+        source.m_nInstance = instanceIndex;
+        source.m_nMesh = i;
+        source.m_nIndexOffset = m_IndexBuffer.size();
+        source.m_nIndexCount = mesh.m_nIndexCount;
+        source.m_nMaterialIndex = -1;
+        source.m_nDrawRange = 0;
+        if(mesh.m_nMaterialIndex >= 0) {
+            const auto* pMaterial = &geometry.getMaterial(mesh.m_nMaterialIndex);
+            auto it = m_MaterialIndices.find(pMaterial);
+            if(it != std::end(m_MaterialIndices)) {
+                source.m_nMaterialIndex = (*it).second;
+            } else {
+                m_Materials.push_back(pMaterial);
+                source.m_nMaterialIndex = m_MaterialIndices[pMaterial] = m_Materials.size() - 1;
+            }
+        }
+        m_MeshSources.push_back(source);
+
+        auto first = m_IndexBuffer.size();
+        for(auto j = 0u; j < mesh.m_nIndexCount; ++j) {
+            m_IndexBuffer.push_back(vertexOffset + pIndices[mesh.m_nIndexOffset + j]);
+        }
+        if(mirror) {
+            for(auto j = first; j + 2 < m_IndexBuffer.size(); j += 3) {
+                std::swap(m_IndexBuffer[j + 1], m_IndexBuffer[j + 2]);
+            }
+        }
+    }
+
+    return instanceIndex;
+}
+
+void GeometryBatch::build() {
+    // Meshes without material go last
+    std::vector<unsigned int> order(m_MeshSources.size());
+    for(auto i = 0u; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(std::begin(order), std::end(order), [&](unsigned int a, unsigned int b) {
+        return unsigned(m_MeshSources[a].m_nMaterialIndex) < unsigned(m_MeshSources[b].m_nMaterialIndex);
+    });
+
+    std::vector<unsigned int> indices(m_IndexBuffer.size());
+    m_DrawRanges.clear();
+    unsigned int offset = 0;
+    for(auto i: order) {
+        auto& source = m_MeshSources[i];
+        if(m_DrawRanges.empty() || m_DrawRanges.back().m_nMaterialIndex != source.m_nMaterialIndex) {
+            DrawRange range = { source.m_nMaterialIndex, offset, 0 };
+            m_DrawRanges.push_back(range);
+        }
+        std::copy(m_IndexBuffer.begin() + source.m_nIndexOffset,
+                  m_IndexBuffer.begin() + source.m_nIndexOffset + source.m_nIndexCount, indices.begin() + offset);
+        source.m_nIndexOffset = offset;
+        source.m_nDrawRange = m_DrawRanges.size() - 1;
+        m_DrawRanges.back().m_nIndexCount += source.m_nIndexCount;
+        offset += source.m_nIndexCount;
+    }
+    m_IndexBuffer.swap(indices);
+    m_bBuilt = true;
+}
+
+void GeometryBatch::clear() {
+    m_VertexBuffer.clear();
+    m_TangentBuffer.clear();
+    m_IndexBuffer.clear();
+    m_DrawRanges.clear();
+    m_Instances.clear();
+    m_MeshSources.clear();
+    m_Materials.clear();
+    m_MaterialIndices.clear();
+    m_BBox = BBox3f(glm::vec3(std::numeric_limits<float>::max()), glm::vec3(-std::numeric_limits<float>::max()));
+    m_bBuilt = true;
+}
+
+}
@@ -29,17 +29,26 @@ std::unique_ptr<Image> loadImage(const FilePath& filepath) {
 }
 
 std::unordered_map<FilePath, std::unique_ptr<Image>> ImageManager::m_ImageMap;
+std::mutex ImageManager::m_ImageMapMutex;
 
 const Image* ImageManager::loadImage(const FilePath& filepath) {
-    auto it = m_ImageMap.find(filepath);
-    if(it != std::end(m_ImageMap)) {
-        return (*it).second.get();
+    {
+        std::lock_guard<std::mutex> lock(m_ImageMapMutex);
+        auto it = m_ImageMap.find(filepath);
+        if(it != std::end(m_ImageMap)) {
+            return (*it).second.get();
+        }
     }
     auto pImage = glimac::loadImage(filepath);
     if(!pImage) {
         return nullptr;
     }
-    auto& img = m_ImageMap[filepath] = std::move(pImage);
+    std::lock_guard<std::mutex> lock(m_ImageMapMutex);
+    // Another thread may have decoded the same file meanwhile: keep the first one
+    auto& img = m_ImageMap[filepath];
+    if(!img) {
+        img = std::move(pImage);
+    }
     return img.get();
 }
 
@@ -0,0 +1,460 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define GLIMAC_USE_SSE
+#endif
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#define GLIMAC_USE_AVX
+#endif
+#if defined(__F16C__) && defined(GLIMAC_USE_SSE)
+#include <immintrin.h>
+#define GLIMAC_USE_F16C
+#endif
+
+namespace glimac {
+
+// Lanes of floats, one ray per lane for the ray queries, one triangle or
+// corner per lane for the normal passes. Comparisons give masks with all the
+// bits of a lane set where they hold, combined with & and | and read with
+// getMask, one bit per lane.
+template<unsigned int N>
+struct ScalarLanes {
+    static const unsigned int SIZE = N;
+    float m_Values[N];
+
+    ScalarLanes() {
+    }
+
+    explicit ScalarLanes(float value) {
+        std::fill(m_Values, m_Values + N, value);
+    }
+
+    static ScalarLanes load(const float* pValues) {
+        ScalarLanes lanes;
+        std::copy(pValues, pValues + N, lanes.m_Values);
+        return lanes;
+    }
+
+    void store(float* pValues) const {
+        std::copy(m_Values, m_Values + N, pValues);
+    }
+
+    // Rounded toward zero
+    void storeTruncated(int32_t* pValues) const {
+        for(auto i = 0u; i < N; ++i) {
+            pValues[i] = int32_t(m_Values[i]);
+        }
+    }
+};
+
+template<unsigned int N, typename Op>
+ScalarLanes<N> apply(const ScalarLanes<N>& a, const ScalarLanes<N>& b, const Op& op) {
+    ScalarLanes<N> result;
+    for(auto i = 0u; i < N; ++i) {
+        result.m_Values[i] = op(a.m_Values[i], b.m_Values[i]);
+    }
+    return result;
+}
+
+inline float toMask(bool value) {
+    uint32_t bits = value ? ~0u : 0u;
+    float mask;
+    std::memcpy(&mask, &bits, sizeof(mask));
+    return mask;
+}
+
+inline uint32_t toBits(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float fromBits(uint32_t bits) {
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+template<unsigned int N>
+ScalarLanes<N> operator+(const ScalarLanes<N>& a, const ScalarLanes<N>& b) {
+    return apply(a, b, [](float x, float y) { return x + y; });
+}
+
+template<unsigned int N>
+ScalarLanes<N> operator-(const ScalarLanes<N>& a, const ScalarLanes<N>& b) {
+    return apply(a, b, [](float x, float y) { return x - y; });
+}
+
+template<unsigned int N>
+ScalarLanes<N> operator*(const ScalarLanes<N>& a, const ScalarLanes<N>& b) {
+    return apply(a, b, [](float x, float y) { return x * y; });
+}
+
+template<unsigned int N>
+ScalarLanes<N> operator/(const ScalarLanes<N>& a, const ScalarLanes<N>& b) {
+    return apply(a, b, [](float x, float y) { return x / y; });
+}
+
+template<unsigned int N>
+ScalarLanes<N> min(const ScalarLanes<N>& a, const ScalarLanes<N>& b) {
+    return apply(a, b, [](float x, float y) { return x < y ? x : y; });
+}
+
+template<unsigned int N>
+ScalarLanes<N> max(const ScalarLanes<N>& a, const ScalarLanes<N>& b) {
+    return apply(a, b, [](float x, float y) { return x > y ? x : y; });
+}
+
+template<unsigned int N>
+ScalarLanes<N> sqrt(const ScalarLanes<N>& a) {
+    return apply(a, a, [](float x, float) { return std::sqrt(x); });
+}
+
+template<unsigned int N>
+ScalarLanes<N> operator<(const ScalarLanes<N>& a, const ScalarLanes<N>& b) {
+    return apply(a, b, [](float x, float y) { return toMask(x < y); });
+}
+
+template<unsigned int N>
+ScalarLanes<N> operator<=(const ScalarLanes<N>& a, const ScalarLanes<N>& b) {
+    return apply(a, b, [](float x, float y) { return toMask(x <= y); });
+}
+
+template<unsigned int N>
+ScalarLanes<N> operator&(const ScalarLanes<N>& a, const ScalarLanes<N>& b) {
+    return apply(a, b, [](float x, float y) { return fromBits(toBits(x) & toBits(y)); });
+}
+
+template<unsigned int N>
+ScalarLanes<N> operator|(const ScalarLanes<N>& a, const ScalarLanes<N>& b) {
+    return apply(a, b, [](float x, float y) { return fromBits(toBits(x) | toBits(y)); });
+}
+
+// a where mask is set, b elsewhere
+template<unsigned int N>
+ScalarLanes<N> select(const ScalarLanes<N>& mask, const ScalarLanes<N>& a, const ScalarLanes<N>& b) {
+    ScalarLanes<N> result;
+    for(auto i = 0u; i < N; ++i) {
+        result.m_Values[i] = toBits(mask.m_Values[i]) ? a.m_Values[i] : b.m_Values[i];
+    }
+    return result;
+}
+
+template<unsigned int N>
+unsigned int getMask(const ScalarLanes<N>& mask) {
+    unsigned int bits = 0;
+    for(auto i = 0u; i < N; ++i) {
+        bits |= (toBits(mask.m_Values[i]) >> 31) << i;
+    }
+    return bits;
+}
+
+#ifdef GLIMAC_USE_SSE
+struct SSELanes {
+    static const unsigned int SIZE = 4;
+    __m128 m_Value;
+
+    SSELanes() {
+    }
+
+    SSELanes(__m128 value): m_Value(value) {
+    }
+
+    explicit SSELanes(float value): m_Value(_mm_set1_ps(value)) {
+    }
+
+    static SSELanes load(const float* pValues) {
+        return _mm_loadu_ps(pValues);
+    }
+
+    void store(float* pValues) const {
+        _mm_storeu_ps(pValues, m_Value);
+    }
+
+    void storeTruncated(int32_t* pValues) const {
+#ifdef __SSE2__
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pValues), _mm_cvttps_epi32(m_Value));
+#else
+        float values[SIZE];
+        store(values);
+        for(auto i = 0u; i < SIZE; ++i) {
+            pValues[i] = int32_t(values[i]);
+        }
+#endif
+    }
+};
+
+inline SSELanes operator+(SSELanes a, SSELanes b) {
+    return _mm_add_ps(a.m_Value, b.m_Value);
+}
+
+inline SSELanes operator-(SSELanes a, SSELanes b) {
+    return _mm_sub_ps(a.m_Value, b.m_Value);
+}
+
+inline SSELanes operator*(SSELanes a, SSELanes b) {
+    return _mm_mul_ps(a.m_Value, b.m_Value);
+}
+
+inline SSELanes operator/(SSELanes a, SSELanes b) {
+    return _mm_div_ps(a.m_Value, b.m_Value);
+}
+
+inline SSELanes min(SSELanes a, SSELanes b) {
+    return _mm_min_ps(a.m_Value, b.m_Value);
+}
+
+inline SSELanes max(SSELanes a, SSELanes b) {
+    return _mm_max_ps(a.m_Value, b.m_Value);
+}
+
+inline SSELanes sqrt(SSELanes a) {
+    return _mm_sqrt_ps(a.m_Value);
+}
+
+inline SSELanes operator<(SSELanes a, SSELanes b) {
+    return _mm_cmplt_ps(a.m_Value, b.m_Value);
+}
+
+inline SSELanes operator<=(SSELanes a, SSELanes b) {
+    return _mm_cmple_ps(a.m_Value, b.m_Value);
+}
+
+inline SSELanes operator&(SSELanes a, SSELanes b) {
+    return _mm_and_ps(a.m_Value, b.m_Value);
+}
+
+inline SSELanes operator|(SSELanes a, SSELanes b) {
+    return _mm_or_ps(a.m_Value, b.m_Value);
+}
+
+inline SSELanes select(SSELanes mask, SSELanes a, SSELanes b) {
+    return _mm_or_ps(_mm_and_ps(mask.m_Value, a.m_Value), _mm_andnot_ps(mask.m_Value, b.m_Value));
+}
+
+inline unsigned int getMask(SSELanes mask) {
+    return _mm_movemask_ps(mask.m_Value);
+}
+#endif
+
+#ifdef GLIMAC_USE_AVX
+struct AVXLanes {
+    static const unsigned int SIZE = 8;
+    __m256 m_Value;
+
+    AVXLanes() {
+    }
+
+    AVXLanes(__m256 value): m_Value(value) {
+    }
+
+    explicit AVXLanes(float value): m_Value(_mm256_set1_ps(value)) {
+    }
+
+    static AVXLanes load(const float* pValues) {
+        return _mm256_loadu_ps(pValues);
+    }
+
+    void store(float* pValues) const {
+        _mm256_storeu_ps(pValues, m_Value);
+    }
+
+    void storeTruncated(int32_t* pValues) const {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(pValues), _mm256_cvttps_epi32(m_Value));
+    }
+};
+
+inline AVXLanes operator+(AVXLanes a, AVXLanes b) {
+    return _mm256_add_ps(a.m_Value, b.m_Value);
+}
+
+inline AVXLanes operator-(AVXLanes a, AVXLanes b) {
+    return _mm256_sub_ps(a.m_Value, b.m_Value);
+}
+
+inline AVXLanes operator*(AVXLanes a, AVXLanes b) {
+    return _mm256_mul_ps(a.m_Value, b.m_Value);
+}
+
+inline AVXLanes operator/(AVXLanes a, AVXLanes b) {
+    return _mm256_div_ps(a.m_Value, b.m_Value);
+}
+
+inline AVXLanes min(AVXLanes a, AVXLanes b) {
+    return _mm256_min_ps(a.m_Value, b.m_Value);
+}
+
+inline AVXLanes max(AVXLanes a, AVXLanes b) {
+    return _mm256_max_ps(a.m_Value, b.m_Value);
+}
+
+inline AVXLanes sqrt(AVXLanes a) {
+    return _mm256_sqrt_ps(a.m_Value);
+}
+
+inline AVXLanes operator<(AVXLanes a, AVXLanes b) {
+    return _mm256_cmp_ps(a.m_Value, b.m_Value, _CMP_LT_OQ);
+}
+
+inline AVXLanes operator<=(AVXLanes a, AVXLanes b) {
+    return _mm256_cmp_ps(a.m_Value, b.m_Value, _CMP_LE_OQ);
+}
+
+inline AVXLanes operator&(AVXLanes a, AVXLanes b) {
+    return _mm256_and_ps(a.m_Value, b.m_Value);
+}
+
+inline AVXLanes operator|(AVXLanes a, AVXLanes b) {
+    return _mm256_or_ps(a.m_Value, b.m_Value);
+}
+
+inline AVXLanes select(AVXLanes mask, AVXLanes a, AVXLanes b) {
+    return _mm256_blendv_ps(b.m_Value, a.m_Value, mask.m_Value);
+}
+
+inline unsigned int getMask(AVXLanes mask) {
+    return _mm256_movemask_ps(mask.m_Value);
+}
+#endif
+
+// Twice the lanes of T, for 8-wide packets without AVX
+template<typename T>
+struct LanePair {
+    static const unsigned int SIZE = 2 * T::SIZE;
+    T m_Low, m_High;
+
+    LanePair() {
+    }
+
+    LanePair(const T& low, const T& high): m_Low(low), m_High(high) {
+    }
+
+    explicit LanePair(float value): m_Low(value), m_High(value) {
+    }
+
+    static LanePair load(const float* pValues) {
+        return LanePair(T::load(pValues), T::load(pValues + T::SIZE));
+    }
+
+    void store(float* pValues) const {
+        m_Low.store(pValues);
+        m_High.store(pValues + T::SIZE);
+    }
+
+    void storeTruncated(int32_t* pValues) const {
+        m_Low.storeTruncated(pValues);
+        m_High.storeTruncated(pValues + T::SIZE);
+    }
+};
+
+template<typename T>
+LanePair<T> operator+(const LanePair<T>& a, const LanePair<T>& b) {
+    return LanePair<T>(a.m_Low + b.m_Low, a.m_High + b.m_High);
+}
+
+template<typename T>
+LanePair<T> operator-(const LanePair<T>& a, const LanePair<T>& b) {
+    return LanePair<T>(a.m_Low - b.m_Low, a.m_High - b.m_High);
+}
+
+template<typename T>
+LanePair<T> operator*(const LanePair<T>& a, const LanePair<T>& b) {
+    return LanePair<T>(a.m_Low * b.m_Low, a.m_High * b.m_High);
+}
+
+template<typename T>
+LanePair<T> operator/(const LanePair<T>& a, const LanePair<T>& b) {
+    return LanePair<T>(a.m_Low / b.m_Low, a.m_High / b.m_High);
+}
+
+template<typename T>
+LanePair<T> min(const LanePair<T>& a, const LanePair<T>& b) {
+    return LanePair<T>(min(a.m_Low, b.m_Low), min(a.m_High, b.m_High));
+}
+
+template<typename T>
+LanePair<T> max(const LanePair<T>& a, const LanePair<T>& b) {
+    return LanePair<T>(max(a.m_Low, b.m_Low), max(a.m_High, b.m_High));
+}
+
+template<typename T>
+LanePair<T> sqrt(const LanePair<T>& a) {
+    return LanePair<T>(sqrt(a.m_Low), sqrt(a.m_High));
+}
+
+template<typename T>
+LanePair<T> operator<(const LanePair<T>& a, const LanePair<T>& b) {
+    return LanePair<T>(a.m_Low < b.m_Low, a.m_High < b.m_High);
+}
+
+template<typename T>
+LanePair<T> operator<=(const LanePair<T>& a, const LanePair<T>& b) {
+    return LanePair<T>(a.m_Low <= b.m_Low, a.m_High <= b.m_High);
+}
+
+template<typename T>
+LanePair<T> operator&(const LanePair<T>& a, const LanePair<T>& b) {
+    return LanePair<T>(a.m_Low & b.m_Low, a.m_High & b.m_High);
+}
+
+template<typename T>
+LanePair<T> operator|(const LanePair<T>& a, const LanePair<T>& b) {
+    return LanePair<T>(a.m_Low | b.m_Low, a.m_High | b.m_High);
+}
+
+template<typename T>
+LanePair<T> select(const LanePair<T>& mask, const LanePair<T>& a, const LanePair<T>& b) {
+    return LanePair<T>(select(mask.m_Low, a.m_Low, b.m_Low), select(mask.m_High, a.m_High, b.m_High));
+}
+
+template<typename T>
+unsigned int getMask(const LanePair<T>& mask) {
+    return getMask(mask.m_Low) | getMask(mask.m_High) << T::SIZE;
+}
+
+typedef ScalarLanes<1> Lanes1;
+#if defined(GLIMAC_USE_AVX)
+typedef SSELanes Lanes4;
+typedef AVXLanes Lanes8;
+#elif defined(GLIMAC_USE_SSE)
+typedef SSELanes Lanes4;
+typedef LanePair<SSELanes> Lanes8;
+#else
+typedef ScalarLanes<4> Lanes4;
+typedef ScalarLanes<8> Lanes8;
+#endif
+
+template<typename Float>
+void cross(const Float* a, const Float* b, Float* result) {
+    result[0] = a[1] * b[2] - a[2] * b[1];
+    result[1] = a[2] * b[0] - a[0] * b[2];
+    result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+template<typename Float>
+Float dot(const Float* a, const Float* b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Sum of the lanes
+template<typename Float>
+float sumLanes(const Float& lanes) {
+    float values[Float::SIZE];
+    lanes.store(values);
+    float sum = 0.f;
+    for(auto value: values) {
+        sum += value;
+    }
+    return sum;
+}
+
+}
@@ -5,6 +5,18 @@
 //
 
 //
+// version 0.9.15: Perfect-hash MTL keyword dispatch, hashed usemtl lookup.
+// version 0.9.14: Bounded-memory LoadObjMapped for ShapeBuilder, large face
+//                 groups are handed over in pieces.
+// version 0.9.13: Progress report and cancellation through ShapeBuilder.
+// version 0.9.12: ShapeBuilder callbacks to receive face groups without shape_t.
+//                 A shape is no longer dropped when its last face group is empty.
+// version 0.9.11: Locale-independent number scanners (ScanFloat, ScanInt).
+//                 Define TINYOBJLOADER_USE_ATOF to go back to atof/atoi.
+// version 0.9.10: Open-addressing vertex cache, shared across the face groups
+//                 of a shape (it was copied and discarded on every flush).
+// version 0.9.9: Multi-threaded chunked loader (LoadObjParallel).
+// version 0.9.8: Memory-mapped loader (LoadObjMapped), no line length limit.
 // version 0.9.7: Support multi-materials(per-face material ID) per object/group.
 // version 0.9.6: Support Ni(index of refraction) mtl parameter.
 //                Parse transmittance material parameter correctly.
@@ -21,34 +33,31 @@
 #include <cstdlib>
 #include <cstring>
 #include <cassert>
+#include <cfloat>
+#include <locale>
 
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #include "tiny_obj_loader.h"
+#include "glimac/Parallel.hpp"
 
 namespace tinyobj {
 
-struct vertex_index {
-  int v_idx, vt_idx, vn_idx;
-  vertex_index() {};
-  vertex_index(int idx) : v_idx(idx), vt_idx(idx), vn_idx(idx) {};
-  vertex_index(int vidx, int vtidx, int vnidx) : v_idx(vidx), vt_idx(vtidx), vn_idx(vnidx) {};
-
-};
-// for std::map
-static inline bool operator<(const vertex_index& a, const vertex_index& b)
-{
-  if (a.v_idx != b.v_idx) return (a.v_idx < b.v_idx);
-  if (a.vn_idx != b.vn_idx) return (a.vn_idx < b.vn_idx);
-  if (a.vt_idx != b.vt_idx) return (a.vt_idx < b.vt_idx);
-
-  return false;
-}
-
 struct obj_shape {
   std::vector<float> v;
   std::vector<float> vn;
@@ -80,60 +89,300 @@ static inline int fixIndex(int idx, int n)
 
 static inline std::string parseString(const char*& token)
 {
-  std::string s;
-  int b = strspn(token, " \t");
-  int e = strcspn(token, " \t\r");
-  s = std::string(&token[b], &token[e]);
+  token += strspn(token, " \t");
+  int e = strcspn(token, " \t\r\n");
+  std::string s(token, token + e);
 
-  token += (e - b);
+  token += e;
   return s;
 }
 
-static inline int parseInt(const char*& token)
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) || defined(_M_X64) || defined(_M_IX86)
+#define TINYOBJ_LITTLE_ENDIAN 1
+#endif
+
+static inline bool isDigit(const char c) {
+  return static_cast<unsigned char>(c - '0') < 10;
+}
+
+static inline bool isSeparator(const char c) {
+  return isSpace(c) || isNewLine(c);
+}
+
+// Converts the 8 characters at p to their value if they are all digits.
+// Needs 8 readable bytes.
+static inline bool parseEightDigits(const char* p, unsigned int& value)
+{
+#ifdef TINYOBJ_LITTLE_ENDIAN
+  unsigned long long v;
+  memcpy(&v, p, 8);
+  // Every byte must be in 0x30..0x39: high nibble 3, and no carry out of the
+  // low nibble when adding 6.
+  if ((((v & 0xF0F0F0F0F0F0F0F0ull) | (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)))
+      != 0x3333333333333333ull) {
+    return false;
+  }
+  v = (v & 0x0F0F0F0F0F0F0F0Full) * 2561 >> 8;
+  v = (v & 0x00FF00FF00FF00FFull) * 6553601 >> 16;
+  value = static_cast<unsigned int>((v & 0x0000FFFF0000FFFFull) * 42949672960001ull >> 32);
+  return true;
+#else
+  value = 0;
+  for (int i = 0; i < 8; ++i) {
+    if (!isDigit(p[i])) return false;
+    value = 10 * value + (p[i] - '0');
+  }
+  return true;
+#endif
+}
+
+// Appends the digit run at p to 'mantissa', keeping at most 19 significant
+// digits so that it cannot overflow, eight digits at a time when possible.
+// 'count' is the length of the run and 'kept' the number of its digits that
+// went into the mantissa; 'truncated' is set if a non-zero digit was dropped.
+static inline const char* scanDigits(
+  const char* p, const char* last,
+  unsigned long long& mantissa, int& significant,
+  int& count, int& kept, bool& truncated)
+{
+  const char* first = p;
+  kept = 0;
+
+  unsigned int eight;
+  while (significant <= 11 && last - p >= 8 && parseEightDigits(p, eight)) {
+    bool leadingZeros = mantissa == 0;
+    mantissa = mantissa * 100000000ull + eight;
+    if (!leadingZeros) {
+      significant += 8;
+    } else {
+      for (unsigned long long m = mantissa; m != 0; m /= 10) ++significant;
+    }
+    kept += 8;
+    p += 8;
+  }
+  while (p < last && isDigit(*p)) {
+    if (significant < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      if (mantissa != 0) ++significant;
+      ++kept;
+    } else if (*p != '0') {
+      truncated = true;
+    }
+    ++p;
+  }
+  count = static_cast<int>(p - first);
+  return p;
+}
+
+// Correctly rounded fallback for the rare numbers the fast paths cannot
+// handle (more than 19 digits, huge exponents, float subnormals, inf/nan).
+static float slowParseFloat(const char* first, const char* last)
+{
+  std::string number(first, last);
+  if (number.find_first_of("0123456789") == std::string::npos) {
+    // inf/nan spellings do not depend on the locale
+    return strtof(number.c_str(), NULL);
+  }
+  std::istringstream stream(number);
+  stream.imbue(std::locale::classic());
+  float value = 0.f;
+  stream >> value;
+  if (stream.fail() && (value == FLT_MAX || value == -FLT_MAX)) {
+    // out of range: streams saturate where strtof returns infinity
+    return value * 2.f;
+  }
+  return value;
+}
+
+const char* ScanFloat(const char* first, const char* last, float& value)
+{
+  static const float floatPowers[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+  };
+  static const double doublePowers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+  };
+
+  const char* p = first;
+  bool negative = false;
+  if (p < last && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  unsigned long long mantissa = 0;
+  int significant = 0, count = 0, kept = 0;
+  int exponent = 0;
+  bool truncated = false;
+
+  p = scanDigits(p, last, mantissa, significant, count, kept, truncated);
+  exponent += count - kept;
+  bool hasDigits = count > 0;
+  if (p < last && *p == '.') {
+    p = scanDigits(p + 1, last, mantissa, significant, count, kept, truncated);
+    exponent -= kept;
+    hasDigits = hasDigits || count > 0;
+  }
+
+  if (!hasDigits) {
+    const char* end = first;
+    while (end < last && !isSeparator(*end) && *end != '/') ++end;
+    value = end != first ? slowParseFloat(first, end) : 0.f;
+    return end;
+  }
+
+  if (p < last && (*p == 'e' || *p == 'E')) {
+    const char* q = p + 1;
+    bool negativeExponent = false;
+    if (q < last && (*q == '-' || *q == '+')) {
+      negativeExponent = *q == '-';
+      ++q;
+    }
+    if (q < last && isDigit(*q)) {
+      int e = 0;
+      for (; q < last && isDigit(*q); ++q) {
+        if (e < 100000) e = 10 * e + (*q - '0');
+      }
+      exponent += negativeExponent ? -e : e;
+      p = q;
+    }
+  }
+
+  if (mantissa == 0) {
+    value = negative ? -0.f : 0.f;
+    return p;
+  }
+
+  if (!truncated) {
+    // Clinger's fast path: both operands are exact, so a single IEEE
+    // operation rounds correctly.
+    if (mantissa <= (1ull << 24) && exponent >= -10 && exponent <= 10) {
+      float f = static_cast<float>(mantissa);
+      f = exponent < 0 ? f / floatPowers[-exponent] : f * floatPowers[exponent];
+      value = negative ? -f : f;
+      return p;
+    }
+    if (mantissa <= (1ull << 53) && exponent >= -22 && exponent <= 22) {
+      double d = static_cast<double>(mantissa);
+      d = exponent < 0 ? d / doublePowers[-exponent] : d * doublePowers[exponent];
+      // Rounding the correctly rounded double to float is only wrong when
+      // the double landed exactly halfway between two floats.
+      unsigned long long bits;
+      memcpy(&bits, &d, sizeof(bits));
+      if ((bits & 0x1FFFFFFFull) != 0x10000000ull && d >= 1.17549435e-38) {
+        float f = static_cast<float>(d);
+        value = negative ? -f : f;
+        return p;
+      }
+    }
+  }
+
+  value = slowParseFloat(first, p);
+  return p;
+}
+
+const char* ScanInt(const char* first, const char* last, int& value)
+{
+  const char* p = first;
+  bool negative = false;
+  if (p < last && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  unsigned long long mantissa = 0;
+  int significant = 0, count = 0, kept = 0;
+  bool truncated = false;
+  p = scanDigits(p, last, mantissa, significant, count, kept, truncated);
+  if (count == 0) {
+    value = 0;
+    return first;
+  }
+
+  // Saturate instead of wrapping around like atoi does.
+  if (truncated || count != kept || mantissa > 2147483647ull) {
+    mantissa = 2147483647ull;
+  }
+  value = negative ? -static_cast<int>(mantissa) : static_cast<int>(mantissa);
+  return p;
+}
+
+// Skips what is left of a token the scanners stopped in.
+static inline const char* skipToken(const char* token, const char* end, const char* separators)
+{
+  if (token < end && !isSeparator(token[0]) && !strchr(separators, token[0])) {
+    token += strcspn(token, separators);
+  }
+  return token;
+}
+
+static inline int parseInt(const char*& token, const char* end)
 {
   token += strspn(token, " \t");
+#ifdef TINYOBJLOADER_USE_ATOF
   int i = atoi(token);
-  token += strcspn(token, " \t\r");
+  token += strcspn(token, " \t\r\n");
+#else
+  int i;
+  token = skipToken(ScanInt(token, end, i), end, " \t\r\n");
+#endif
   return i;
 }
 
-static inline float parseFloat(const char*& token)
+static inline float parseFloat(const char*& token, const char* end)
 {
   token += strspn(token, " \t");
+#ifdef TINYOBJLOADER_USE_ATOF
   float f = (float)atof(token);
-  token += strcspn(token, " \t\r");
+  token += strcspn(token, " \t\r\n");
+#else
+  float f;
+  token = skipToken(ScanFloat(token, end, f), end, " \t\r\n");
+#endif
   return f;
 }
 
 static inline void parseFloat2(
   float& x, float& y,
-  const char*& token)
+  const char*& token, const char* end)
 {
-  x = parseFloat(token);
-  y = parseFloat(token);
+  x = parseFloat(token, end);
+  y = parseFloat(token, end);
 }
 
 static inline void parseFloat3(
   float& x, float& y, float& z,
-  const char*& token)
+  const char*& token, const char* end)
 {
-  x = parseFloat(token);
-  y = parseFloat(token);
-  z = parseFloat(token);
+  x = parseFloat(token, end);
+  y = parseFloat(token, end);
+  z = parseFloat(token, end);
 }
 
+static inline int parseIndex(const char*& token, const char* end)
+{
+#ifdef TINYOBJLOADER_USE_ATOF
+  int i = atoi(token);
+  token += strcspn(token, "/ \t\r\n");
+#else
+  int i;
+  token = skipToken(ScanInt(token, end, i), end, "/ \t\r\n");
+#endif
+  return i;
+}
 
 // Parse triples: i, i/j/k, i//k, i/j
 static vertex_index parseTriple(
   const char* &token,
+  const char* end,
   int vsize,
   int vnsize,
   int vtsize)
 {
     vertex_index vi(-1);
 
-    vi.v_idx = fixIndex(atoi(token), vsize);
-    token += strcspn(token, "/ \t\r");
+    vi.v_idx = fixIndex(parseIndex(token, end), vsize);
     if (token[0] != '/') {
       return vi;
     }
@@ -142,28 +391,25 @@ static vertex_index parseTriple(
     // i//k
     if (token[0] == '/') {
       token++;
-      vi.vn_idx = fixIndex(atoi(token), vnsize);
-      token += strcspn(token, "/ \t\r");
+      vi.vn_idx = fixIndex(parseIndex(token, end), vnsize);
       return vi;
     }
     
     // i/j/k or i/j
-    vi.vt_idx = fixIndex(atoi(token), vtsize);
-    token += strcspn(token, "/ \t\r");
+    vi.vt_idx = fixIndex(parseIndex(token, end), vtsize);
     if (token[0] != '/') {
       return vi;
     }
 
     // i/j/k
     token++;  // skip '/'
-    vi.vn_idx = fixIndex(atoi(token), vnsize);
-    token += strcspn(token, "/ \t\r");
+    vi.vn_idx = fixIndex(parseIndex(token, end), vnsize);
     return vi; 
 }
 
 static unsigned int
 updateVertex(
-  std::map<vertex_index, unsigned int>& vertexCache,
+  VertexCache& vertexCache,
   std::vector<float>& positions,
   std::vector<float>& normals,
   std::vector<float>& texcoords,
@@ -172,11 +418,11 @@ updateVertex(
   const std::vector<float>& in_texcoords,
   const vertex_index& i)
 {
-  const std::map<vertex_index, unsigned int>::iterator it = vertexCache.find(i);
-
-  if (it != vertexCache.end()) {
+  unsigned int idx = positions.size() / 3;
+  unsigned int cached = vertexCache.findOrInsert(i, idx);
+  if (cached != idx) {
     // found cache
-    return it->second;
+    return cached;
   }
 
   assert(in_positions.size() > (unsigned int) (3*i.v_idx+2));
@@ -196,9 +442,6 @@ updateVertex(
     texcoords.push_back(in_texcoords[2*i.vt_idx+1]);
   }
 
-  unsigned int idx = positions.size() / 3 - 1;
-  vertexCache[i] = idx;
-
   return idx;
 }
 
@@ -222,35 +465,38 @@ void InitMaterial(material_t& material) {
   material.unknown_parameter.clear();
 }
 
-static bool
+static void
 exportFaceGroupToShape(
   shape_t& shape,
-  std::map<vertex_index, unsigned int> vertexCache,
+  VertexCache& vertexCache,
   const std::vector<float> &in_positions,
   const std::vector<float> &in_normals,
   const std::vector<float> &in_texcoords,
-  const std::vector<std::vector<vertex_index> >& faceGroup,
+  const vertex_index* indices,
+  const unsigned int* faceSizes,
+  size_t faceCount,
   const int material_id,
-  const std::string &name,
-  bool clearCache)
+  const std::string &name)
 {
-  if (faceGroup.empty()) {
-    return false;
+  // Unique vertices are bounded by the corner count, and in practice by the
+  // size of the largest attribute pool.
+  size_t cornerCount = 0;
+  for (size_t i = 0; i < faceCount; i++) {
+    cornerCount += faceSizes[i];
   }
-
-  size_t offset;
-
-  offset = shape.mesh.indices.size();
+  size_t poolSize = std::max(in_positions.size() / 3, std::max(in_normals.size() / 3, in_texcoords.size() / 2));
+  vertexCache.reserve(std::min(cornerCount, poolSize));
 
   // Flatten vertices and indices
-  for (size_t i = 0; i < faceGroup.size(); i++) {
-    const std::vector<vertex_index>& face = faceGroup[i];
+  for (size_t i = 0; i < faceCount; i++) {
+    const vertex_index* face = indices;
+    indices += faceSizes[i];
 
     vertex_index i0 = face[0];
     vertex_index i1(-1);
     vertex_index i2 = face[1];
 
-    size_t npolys = face.size();
+    size_t npolys = faceSizes[i];
 
     // Polygon -> triangle fan conversion
     for (size_t k = 2; k < npolys; k++) {
@@ -271,12 +517,79 @@ exportFaceGroupToShape(
   }
 
   shape.name = name;
+}
 
-  if (clearCache)
-      vertexCache.clear();
+// ShapeBuilder producing the shape_t output of LoadObj.
+class ShapeVectorBuilder:
+  public ShapeBuilder
+{
+public:
+  ShapeVectorBuilder(std::vector<shape_t>& shapes): m_shapes(shapes) {}
+
+  virtual void faceGroup(
+    const std::string& name, int material_id,
+    const vertex_index* indices, const unsigned int* faceSizes, size_t faceCount,
+    const std::vector<float>& v, const std::vector<float>& vn, const std::vector<float>& vt)
+  {
+    exportFaceGroupToShape(m_shape, m_vertexCache, v, vn, vt, indices, faceSizes, faceCount, material_id, name);
+  }
 
-  return true;
+  virtual void endShape()
+  {
+    if (!m_shape.mesh.indices.empty()) {
+      m_shapes.push_back(shape_t());
+      std::swap(m_shapes.back(), m_shape);
+    }
+    m_shape = shape_t();
+    m_vertexCache.clear();
+  }
 
+private:
+  std::vector<shape_t>& m_shapes;
+  shape_t m_shape;
+  VertexCache m_vertexCache;   // shared by the face groups of the current shape
+};
+
+enum MtlKeyword {
+  MTL_UNKNOWN, MTL_NEWMTL, MTL_KA, MTL_KD, MTL_KS, MTL_KT, MTL_KE, MTL_NI, MTL_NS,
+  MTL_ILLUM, MTL_D, MTL_TR, MTL_MAP_KA, MTL_MAP_KD, MTL_MAP_KS, MTL_MAP_NS
+};
+
+struct MtlKeywordEntry {
+  const char* name;
+  size_t length;
+  MtlKeyword keyword;
+};
+
+// Perfect hash of the MTL keywords: first char + last char + 3 * second to
+// last char + length, modulo 32. No two keywords share a slot, so a lookup is
+// a hash and a single compare.
+static const MtlKeywordEntry mtlKeywords[32] = {
+  { NULL, 0, MTL_UNKNOWN },     { "Ks", 2, MTL_KS },          { "Kt", 2, MTL_KT },
+  { "Ni", 2, MTL_NI },          { "Tr", 2, MTL_TR },          { NULL, 0, MTL_UNKNOWN },
+  { NULL, 0, MTL_UNKNOWN },     { "map_Ks", 6, MTL_MAP_KS },  { NULL, 0, MTL_UNKNOWN },
+  { "d", 1, MTL_D },            { NULL, 0, MTL_UNKNOWN },     { NULL, 0, MTL_UNKNOWN },
+  { NULL, 0, MTL_UNKNOWN },     { "Ns", 2, MTL_NS },          { NULL, 0, MTL_UNKNOWN },
+  { "Ka", 2, MTL_KA },          { "map_Ns", 6, MTL_MAP_NS },  { NULL, 0, MTL_UNKNOWN },
+  { "Kd", 2, MTL_KD },          { "Ke", 2, MTL_KE },          { NULL, 0, MTL_UNKNOWN },
+  { "map_Ka", 6, MTL_MAP_KA },  { NULL, 0, MTL_UNKNOWN },     { NULL, 0, MTL_UNKNOWN },
+  { "map_Kd", 6, MTL_MAP_KD },  { NULL, 0, MTL_UNKNOWN },     { "illum", 5, MTL_ILLUM },
+  { NULL, 0, MTL_UNKNOWN },     { "newmtl", 6, MTL_NEWMTL },  { NULL, 0, MTL_UNKNOWN },
+  { NULL, 0, MTL_UNKNOWN },     { NULL, 0, MTL_UNKNOWN },
+};
+
+static inline MtlKeyword findMtlKeyword(const char* token, size_t length)
+{
+  if (length == 0 || length > 6) {
+    return MTL_UNKNOWN;
+  }
+  const unsigned char* c = reinterpret_cast<const unsigned char*>(token);
+  size_t h = (c[0] + c[length - 1] + 3 * (length > 1 ? c[length - 2] : 0) + length) & 31;
+  const MtlKeywordEntry& entry = mtlKeywords[h];
+  if (entry.length != length || memcmp(entry.name, token, length) != 0) {
+    return MTL_UNKNOWN;
+  }
+  return entry.keyword;
 }
 
 std::string LoadMtl (
@@ -311,6 +624,7 @@ std::string LoadMtl (
 
     // Skip leading space.
     const char* token = linebuf.c_str();
+    const char* end = token + linebuf.size();
     token += strspn(token, " \t");
 
     assert(token);
@@ -318,8 +632,13 @@ std::string LoadMtl (
     
     if (token[0] == '#') continue;  // comment line
     
-    // new mtl
-    if ((0 == strncmp(token, "newmtl", 6)) && isSpace((token[6]))) {
+    size_t keywordLength = strcspn(token, " \t");
+    MtlKeyword keyword = isSpace(token[keywordLength]) ? findMtlKeyword(token, keywordLength) : MTL_UNKNOWN;
+    token += keywordLength;
+
+    float r, g, b;
+    switch (keyword) {
+    case MTL_NEWMTL: {
       // flush previous material.
       if (!material.name.empty())
       {
@@ -332,138 +651,80 @@ std::string LoadMtl (
 
       // set new mtl name
       char namebuf[4096];
-      token += 7;
-      sscanf(token, "%s", namebuf);
+      sscanf(token + 1, "%s", namebuf);
       material.name = namebuf;
-      continue;
+      break;
     }
-    
-    // ambient
-    if (token[0] == 'K' && token[1] == 'a' && isSpace((token[2]))) {
-      token += 2;
-      float r, g, b;
-      parseFloat3(r, g, b, token);
+    case MTL_KA:  // ambient
+      parseFloat3(r, g, b, token, end);
       material.ambient[0] = r;
       material.ambient[1] = g;
       material.ambient[2] = b;
-      continue;
-    }
-    
-    // diffuse
-    if (token[0] == 'K' && token[1] == 'd' && isSpace((token[2]))) {
-      token += 2;
-      float r, g, b;
-      parseFloat3(r, g, b, token);
+      break;
+    case MTL_KD:  // diffuse
+      parseFloat3(r, g, b, token, end);
       material.diffuse[0] = r;
       material.diffuse[1] = g;
       material.diffuse[2] = b;
-      continue;
-    }
-    
-    // specular
-    if (token[0] == 'K' && token[1] == 's' && isSpace((token[2]))) {
-      token += 2;
-      float r, g, b;
-      parseFloat3(r, g, b, token);
+      break;
+    case MTL_KS:  // specular
+      parseFloat3(r, g, b, token, end);
       material.specular[0] = r;
       material.specular[1] = g;
       material.specular[2] = b;
-      continue;
-    }
-    
-    // transmittance
-    if (token[0] == 'K' && token[1] == 't' && isSpace((token[2]))) {
-      token += 2;
-      float r, g, b;
-      parseFloat3(r, g, b, token);
+      break;
+    case MTL_KT:  // transmittance
+      parseFloat3(r, g, b, token, end);
       material.transmittance[0] = r;
       material.transmittance[1] = g;
       material.transmittance[2] = b;
-      continue;
-    }
-
-    // ior(index of refraction)
-    if (token[0] == 'N' && token[1] == 'i' && isSpace((token[2]))) {
-      token += 2;
-      material.ior = parseFloat(token);
-      continue;
-    }
-
-    // emission
-    if(token[0] == 'K' && token[1] == 'e' && isSpace(token[2])) {
-      token += 2;
-      float r, g, b;
-      parseFloat3(r, g, b, token);
+      break;
+    case MTL_KE:  // emission
+      parseFloat3(r, g, b, token, end);
       material.emission[0] = r;
       material.emission[1] = g;
       material.emission[2] = b;
-      continue;
-    }
-
-    // shininess
-    if(token[0] == 'N' && token[1] == 's' && isSpace(token[2])) {
-      token += 2;
-      material.shininess = parseFloat(token);
-      continue;
-    }
-
-    // illum model
-    if (0 == strncmp(token, "illum", 5) && isSpace(token[5])) {
-      token += 6;
-      material.illum = parseInt(token);
-      continue;
-    }
-
-    // dissolve
-    if ((token[0] == 'd' && isSpace(token[1]))) {
-      token += 1;
-      material.dissolve = parseFloat(token);
-      continue;
-    }
-    if (token[0] == 'T' && token[1] == 'r' && isSpace(token[2])) {
-      token += 2;
-      material.dissolve = parseFloat(token);
-      continue;
-    }
-
-    // ambient texture
-    if ((0 == strncmp(token, "map_Ka", 6)) && isSpace(token[6])) {
-      token += 7;
-      material.ambient_texname = token;
-      continue;
-    }
-
-    // diffuse texture
-    if ((0 == strncmp(token, "map_Kd", 6)) && isSpace(token[6])) {
-      token += 7;
-      material.diffuse_texname = token;
-      continue;
-    }
-
-    // specular texture
-    if ((0 == strncmp(token, "map_Ks", 6)) && isSpace(token[6])) {
-      token += 7;
-      material.specular_texname = token;
-      continue;
-    }
-
-    // normal texture
-    if ((0 == strncmp(token, "map_Ns", 6)) && isSpace(token[6])) {
-      token += 7;
-      material.normal_texname = token;
-      continue;
-    }
-
-    // unknown parameter
-    const char* _space = strchr(token, ' ');
-    if(!_space) {
-      _space = strchr(token, '\t');
+      break;
+    case MTL_NI:  // ior(index of refraction)
+      material.ior = parseFloat(token, end);
+      break;
+    case MTL_NS:  // shininess
+      material.shininess = parseFloat(token, end);
+      break;
+    case MTL_ILLUM:  // illum model
+      material.illum = parseInt(token, end);
+      break;
+    case MTL_D:  // dissolve
+    case MTL_TR:
+      material.dissolve = parseFloat(token, end);
+      break;
+    case MTL_MAP_KA:  // ambient texture
+      material.ambient_texname = token + 1;
+      break;
+    case MTL_MAP_KD:  // diffuse texture
+      material.diffuse_texname = token + 1;
+      break;
+    case MTL_MAP_KS:  // specular texture
+      material.specular_texname = token + 1;
+      break;
+    case MTL_MAP_NS:  // normal texture
+      material.normal_texname = token + 1;
+      break;
+    case MTL_UNKNOWN: {
+      // unknown parameter
+      token -= keywordLength;
+      const char* _space = strchr(token, ' ');
+      if(!_space) {
+        _space = strchr(token, '\t');
+      }
+      if(_space) {
+        int len = _space - token;
+        std::string key(token, len);
+        std::string value = _space + 1;
+        material.unknown_parameter.insert(std::pair<std::string, std::string>(key, value));
+      }
+      break;
     }
-    if(_space) {
-      int len = _space - token;
-      std::string key(token, len);
-      std::string value = _space + 1;
-      material.unknown_parameter.insert(std::pair<std::string, std::string>(key, value));
     }
   }
   // flush last material.
@@ -486,9 +747,536 @@ std::string MaterialFileReader::operator() (
     filepath = matId;
   }
 
+  m_filenames.push_back(filepath);
   std::ifstream matIStream(filepath.c_str());
   return LoadMtl(matMap, materials, matIStream);
 }
+// Tokenizes one line and forwards the record to 'h'.
+// The line is not required to be NUL-terminated: it ends at the first '\n',
+// '\r' or '\0', so the mapped loaders can tokenize directly over the file
+// bytes. 'end' is the end of the readable buffer, the number scanners may
+// look ahead up to it. Returns false if loading must be aborted, the reason
+// is in err.
+template <class Handler>
+static bool parseObjLine(const char* token, const char* end, Handler& h, std::string& err)
+{
+  // Skip leading space.
+  token += strspn(token, " \t");
+
+  assert(token);
+  if (isNewLine(token[0])) return true; // empty line
+
+  if (token[0] == '#') return true;  // comment line
+
+  // vertex
+  if (token[0] == 'v' && isSpace((token[1]))) {
+    token += 2;
+    float x, y, z;
+    parseFloat3(x, y, z, token, end);
+    h.vertex(x, y, z);
+    return true;
+  }
+
+  // normal
+  if (token[0] == 'v' && token[1] == 'n' && isSpace((token[2]))) {
+    token += 3;
+    float x, y, z;
+    parseFloat3(x, y, z, token, end);
+    h.normal(x, y, z);
+    return true;
+  }
+
+  // texcoord
+  if (token[0] == 'v' && token[1] == 't' && isSpace((token[2]))) {
+    token += 3;
+    float x, y;
+    parseFloat2(x, y, token, end);
+    h.texcoord(x, y);
+    return true;
+  }
+
+  // face
+  if (token[0] == 'f' && isSpace((token[1]))) {
+    token += 2;
+    token += strspn(token, " \t");
+
+    std::vector<vertex_index>& face = h.faceBuffer();
+    face.clear();
+    while (!isNewLine(token[0])) {
+      vertex_index vi = parseTriple(token, end, h.vertexCount(), h.normalCount(), h.texcoordCount());
+      face.push_back(vi);
+      int n = strspn(token, " \t\r");
+      token += n;
+    }
+
+    h.face(face.data(), face.size());
+
+    return true;
+  }
+
+  // use mtl
+  if ((0 == strncmp(token, "usemtl", 6)) && isSpace((token[6]))) {
+    token += 7;
+    h.useMaterial(parseString(token));
+    return true;
+  }
+
+  // load mtl
+  if ((0 == strncmp(token, "mtllib", 6)) && isSpace((token[6]))) {
+    token += 7;
+    return h.materialLibrary(parseString(token), err);
+  }
+
+  // group name
+  if (token[0] == 'g' && isSpace((token[1]))) {
+    std::vector<std::string> names;
+    while (!isNewLine(token[0])) {
+      std::string str = parseString(token);
+      names.push_back(str);
+      token += strspn(token, " \t\r"); // skip tag
+    }
+
+    assert(names.size() > 0);
+
+    // names[0] must be 'g', so skipt 0th element.
+    h.group(names.size() > 1 ? names[1] : std::string());
+    return true;
+  }
+
+  // object name
+  if (token[0] == 'o' && isSpace((token[1]))) {
+    // @todo { multiple object name? }
+    token += 2;
+    h.object(parseString(token));
+    return true;
+  }
+
+  // Ignore unknown command.
+  return true;
+}
+
+// Calls fn(line, bufferEnd) for each line in [begin, end). An unterminated
+// last line is copied, since the mapping may end exactly on a page boundary.
+template <class LineFn>
+static bool forEachLine(const char* begin, const char* end, LineFn fn)
+{
+  const char* line = begin;
+  while (line < end) {
+    const char* eol = static_cast<const char*>(memchr(line, '\n', end - line));
+    if (!eol) {
+      std::string lastLine(line, end);
+      return fn(lastLine.c_str(), lastLine.c_str() + lastLine.size());
+    }
+    if (!fn(line, end)) {
+      return false;
+    }
+    line = eol + 1;
+  }
+  return true;
+}
+
+// Feeds the records of an OBJ file, in file order, to a ShapeBuilder.
+class ObjParser
+{
+public:
+  ObjParser(
+    ShapeBuilder& builder,
+    std::vector<material_t>& materials,
+    MaterialReader& readMatFn):
+    m_builder(builder), m_materials(materials), m_readMatFn(readMatFn), m_material(-1)
+  {
+  }
+
+  void vertex(float x, float y, float z) {
+    v.push_back(x);
+    v.push_back(y);
+    v.push_back(z);
+  }
+
+  void normal(float x, float y, float z) {
+    vn.push_back(x);
+    vn.push_back(y);
+    vn.push_back(z);
+  }
+
+  void texcoord(float x, float y) {
+    vt.push_back(x);
+    vt.push_back(y);
+  }
+
+  int vertexCount() const { return v.size() / 3; }
+  int normalCount() const { return vn.size() / 3; }
+  int texcoordCount() const { return vt.size() / 2; }
+
+  std::vector<vertex_index>& faceBuffer() { return m_faceBuffer; }
+
+  void face(const vertex_index* indices, size_t count) {
+    m_faceIndices.insert(m_faceIndices.end(), indices, indices + count);
+    m_faceSizes.push_back(count);
+    if (m_faceSizes.size() >= maxFaceGroupSize) {
+      // Huge groups are handed over in pieces to keep the face buffers small.
+      flushFaceGroup();
+    }
+  }
+
+  void useMaterial(const std::string& mtlName);
+
+  bool materialLibrary(const std::string& mtlFile, std::string& err);
+
+  void group(const std::string& groupName);
+
+  void object(const std::string& objectName);
+
+  void finish();
+
+  bool progress(size_t bytesParsed, size_t totalBytes) {
+    return m_builder.progress(bytesParsed, totalBytes);
+  }
+
+  // Attribute pools, filled in place by the parallel loader.
+  std::vector<float> v;
+  std::vector<float> vn;
+  std::vector<float> vt;
+
+private:
+  static const size_t maxFaceGroupSize = 1 << 16;
+
+  void flushFaceGroup();
+
+  ShapeBuilder& m_builder;
+  std::vector<material_t>& m_materials;
+  MaterialReader& m_readMatFn;
+
+  // Faces since the last usemtl/g/o, flattened
+  std::vector<vertex_index> m_faceIndices;
+  std::vector<unsigned int> m_faceSizes;
+  std::vector<vertex_index> m_faceBuffer;
+  std::string name;
+
+  // material
+  std::map<std::string, int> material_map;
+  std::unordered_map<std::string, int> m_materialIndices;
+  int m_material;
+};
+
+void ObjParser::flushFaceGroup()
+{
+  if (!m_faceSizes.empty()) {
+    m_builder.faceGroup(name, m_material, m_faceIndices.data(), m_faceSizes.data(), m_faceSizes.size(), v, vn, vt);
+  }
+  m_faceIndices.clear();
+  m_faceSizes.clear();
+}
+
+void ObjParser::useMaterial(const std::string& mtlName)
+{
+  flushFaceGroup();
+
+  std::unordered_map<std::string, int>::const_iterator it = m_materialIndices.find(mtlName);
+  if (it != m_materialIndices.end()) {
+    m_material = it->second;
+  } else {
+    // { error!! material not found }
+    m_material = -1;
+  }
+}
+
+bool ObjParser::materialLibrary(const std::string& mtlFile, std::string& err)
+{
+  std::string err_mtl = m_readMatFn(mtlFile, m_materials, material_map);
+  if (!err_mtl.empty()) {
+    err = err_mtl;
+    return false;
+  }
+  // usemtl lookups go through a hash table rather than the reader's map.
+  m_materialIndices.clear();
+  m_materialIndices.insert(material_map.begin(), material_map.end());
+  return true;
+}
+
+void ObjParser::group(const std::string& groupName)
+{
+  // flush previous face group.
+  flushFaceGroup();
+  m_builder.endShape();
+
+  //material = -1;
+  name = groupName;
+}
+
+void ObjParser::object(const std::string& objectName)
+{
+  // flush previous face group.
+  flushFaceGroup();
+  m_builder.endShape();
+
+  //material = -1;
+  name = objectName;
+}
+
+void ObjParser::finish()
+{
+  flushFaceGroup();
+  m_builder.endShape();
+}
+
+// A line-aligned slice of the file for the parallel loader.
+// Attributes are written straight into the shared pools at the chunk base
+// (prefix sum of the counts of the previous chunks), so relative face
+// indices resolve against global counts while parsing. Faces and the
+// usemtl/mtllib/g/o records are kept in order and replayed serially.
+class ObjChunk
+{
+public:
+  struct Command {
+    enum Type { USEMTL, MTLLIB, GROUP, OBJECT };
+    Type type;
+    std::string name;
+    size_t faceIndex;   // number of faces of the chunk preceding the record
+
+    Command(Type t, const std::string& n, size_t f): type(t), name(n), faceIndex(f) {}
+  };
+
+  const char* begin;
+  const char* end;
+
+  // First pass: attribute counts. Second pass: chunk bases.
+  int vBase, vnBase, vtBase;
+  size_t faceCount;
+
+  ObjChunk(): begin(NULL), end(NULL), vBase(0), vnBase(0), vtBase(0), faceCount(0),
+    m_v(NULL), m_vn(NULL), m_vt(NULL), m_vCount(0), m_vnCount(0), m_vtCount(0) {}
+
+  void countAttributes();
+
+  void setPools(float* v, float* vn, float* vt) {
+    m_v = v;
+    m_vn = vn;
+    m_vt = vt;
+  }
+
+  void vertex(float x, float y, float z) {
+    float* p = m_v + 3 * (vBase + m_vCount++);
+    p[0] = x;
+    p[1] = y;
+    p[2] = z;
+  }
+
+  void normal(float x, float y, float z) {
+    float* p = m_vn + 3 * (vnBase + m_vnCount++);
+    p[0] = x;
+    p[1] = y;
+    p[2] = z;
+  }
+
+  void texcoord(float x, float y) {
+    float* p = m_vt + 2 * (vtBase + m_vtCount++);
+    p[0] = x;
+    p[1] = y;
+  }
+
+  int vertexCount() const { return vBase + m_vCount; }
+  int normalCount() const { return vnBase + m_vnCount; }
+  int texcoordCount() const { return vtBase + m_vtCount; }
+
+  std::vector<vertex_index>& faceBuffer() { return m_faceBuffer; }
+
+  void face(const vertex_index* indices, size_t count) {
+    m_faceIndices.insert(m_faceIndices.end(), indices, indices + count);
+    m_faceSizes.push_back(count);
+  }
+
+  void useMaterial(const std::string& mtlName) {
+    m_commands.push_back(Command(Command::USEMTL, mtlName, m_faceSizes.size()));
+  }
+
+  bool materialLibrary(const std::string& mtlFile, std::string&) {
+    m_commands.push_back(Command(Command::MTLLIB, mtlFile, m_faceSizes.size()));
+    return true;
+  }
+
+  void group(const std::string& groupName) {
+    m_commands.push_back(Command(Command::GROUP, groupName, m_faceSizes.size()));
+  }
+
+  void object(const std::string& objectName) {
+    m_commands.push_back(Command(Command::OBJECT, objectName, m_faceSizes.size()));
+  }
+
+  void parse() {
+    std::string err;
+    forEachLine(begin, end, LineParser(*this, err));
+  }
+
+  // Feeds the recorded records to the serial builder, in file order. The
+  // builder is polled for cancellation every few faces, with all of the
+  // 'fileSize' bytes parsed.
+  bool replay(ObjParser& parser, size_t fileSize, std::string& err);
+
+private:
+  struct LineParser {
+    ObjChunk& chunk;
+    std::string& err;
+    LineParser(ObjChunk& c, std::string& e): chunk(c), err(e) {}
+    bool operator()(const char* line, const char* end) { return parseObjLine(line, end, chunk, err); }
+  };
+
+  bool apply(const Command& command, ObjParser& parser, std::string& err);
+
+  float* m_v;
+  float* m_vn;
+  float* m_vt;
+  int m_vCount, m_vnCount, m_vtCount;
+
+  std::vector<vertex_index> m_faceIndices;
+  std::vector<unsigned int> m_faceSizes;
+  std::vector<vertex_index> m_faceBuffer;
+  std::vector<Command> m_commands;
+};
+
+struct AttributeCounter {
+  ObjChunk& chunk;
+  AttributeCounter(ObjChunk& c): chunk(c) {}
+  bool operator()(const char* token, const char*) {
+    token += strspn(token, " \t");
+    if (token[0] == 'v') {
+      if (isSpace(token[1])) {
+        ++chunk.vBase;
+      } else if (token[1] == 'n' && isSpace(token[2])) {
+        ++chunk.vnBase;
+      } else if (token[1] == 't' && isSpace(token[2])) {
+        ++chunk.vtBase;
+      }
+    } else if (token[0] == 'f' && isSpace(token[1])) {
+      ++chunk.faceCount;
+    }
+    return true;
+  }
+};
+
+void ObjChunk::countAttributes()
+{
+  vBase = vnBase = vtBase = 0;
+  faceCount = 0;
+  forEachLine(begin, end, AttributeCounter(*this));
+}
+
+bool ObjChunk::apply(const Command& command, ObjParser& parser, std::string& err)
+{
+  switch (command.type) {
+  case Command::USEMTL:
+    parser.useMaterial(command.name);
+    return true;
+  case Command::MTLLIB:
+    return parser.materialLibrary(command.name, err);
+  case Command::GROUP:
+    parser.group(command.name);
+    return true;
+  case Command::OBJECT:
+    parser.object(command.name);
+    return true;
+  }
+  return true;
+}
+
+bool ObjChunk::replay(ObjParser& parser, size_t fileSize, std::string& err)
+{
+  const size_t pollFaceCount = 1 << 16;
+  size_t nextCommand = 0;
+  const vertex_index* indices = m_faceIndices.data();
+  for (size_t f = 0; f < m_faceSizes.size(); ++f) {
+    if (f % pollFaceCount == pollFaceCount - 1 && !parser.progress(fileSize, fileSize)) {
+      err = "Loading cancelled\n";
+      return false;
+    }
+    for (; nextCommand < m_commands.size() && m_commands[nextCommand].faceIndex == f; ++nextCommand) {
+      if (!apply(m_commands[nextCommand], parser, err)) {
+        return false;
+      }
+    }
+    parser.face(indices, m_faceSizes[f]);
+    indices += m_faceSizes[f];
+  }
+  for (; nextCommand < m_commands.size(); ++nextCommand) {
+    if (!apply(m_commands[nextCommand], parser, err)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+MappedFile::MappedFile(const char* filename):
+  m_data(NULL), m_size(0)
+#ifndef _WIN32
+  , m_mapping(NULL)
+#endif
+{
+#ifdef _WIN32
+  std::ifstream ifs(filename, std::ios::binary | std::ios::ate);
+  if (!ifs) {
+    return;
+  }
+  m_buffer.resize(static_cast<size_t>(ifs.tellg()) + 1, '\0');
+  ifs.seekg(0);
+  ifs.read(&m_buffer[0], m_buffer.size() - 1);
+  m_data = &m_buffer[0];
+  m_size = m_buffer.size() - 1;
+#else
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return;
+  }
+  m_size = static_cast<size_t>(st.st_size);
+  if (m_size == 0) {
+    // mmap refuses empty mappings, an empty file is still a valid file.
+    static const char empty = '\0';
+    m_data = &empty;
+    close(fd);
+    return;
+  }
+  void* mapping = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    m_size = 0;
+    return;
+  }
+  madvise(mapping, m_size, MADV_SEQUENTIAL);
+  m_mapping = mapping;
+  m_data = static_cast<const char*>(mapping);
+#endif
+}
+
+void MappedFile::release(size_t offset, size_t size)
+{
+#ifndef _WIN32
+  if (!m_mapping) {
+    return;
+  }
+  // Only whole pages inside the range can go.
+  size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  size_t first = (offset + pageSize - 1) / pageSize * pageSize;
+  size_t last = std::min(offset + size, m_size) / pageSize * pageSize;
+  if (first < last) {
+    madvise(static_cast<char*>(m_mapping) + first, last - first, MADV_DONTNEED);
+  }
+#else
+  (void)offset; (void)size;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+  if (m_mapping) {
+    munmap(m_mapping, m_size);
+  }
+#endif
+}
 
 std::string
 LoadObj(
@@ -523,202 +1311,237 @@ std::string LoadObj(
   std::istream& inStream,
   MaterialReader& readMatFn)
 {
-  std::stringstream err;
-
-  std::vector<float> v;
-  std::vector<float> vn;
-  std::vector<float> vt;
-  std::vector<std::vector<vertex_index> > faceGroup;
-  std::string name;
-
-  // material
-  std::map<std::string, int> material_map;
-  std::map<vertex_index, unsigned int> vertexCache;
-  int  material = -1;
-
-  shape_t shape;
-
-  int maxchars = 8192;  // Alloc enough size.
-  std::vector<char> buf(maxchars);  // Alloc enough size.
-  while (inStream.peek() != -1) {
-    inStream.getline(&buf[0], maxchars);
-
-    std::string linebuf(&buf[0]);
+  ShapeVectorBuilder builder(shapes);
+  return LoadObj(builder, materials, inStream, readMatFn);
+}
 
-    // Trim newline '\r\n' or '\n'
-    if (linebuf.size() > 0) {
-      if (linebuf[linebuf.size()-1] == '\n') linebuf.erase(linebuf.size()-1);
-    }
-    if (linebuf.size() > 0) {
-      if (linebuf[linebuf.size()-1] == '\r') linebuf.erase(linebuf.size()-1);
-    }
+std::string LoadObj(
+  ShapeBuilder& builder,
+  std::vector<material_t>& materials,   // [output]
+  std::istream& inStream,
+  MaterialReader& readMatFn)
+{
+  std::string err;
+  ObjParser parser(builder, materials, readMatFn);
 
-    // Skip if empty line.
-    if (linebuf.empty()) {
-      continue;
+  std::string linebuf;
+  while (std::getline(inStream, linebuf)) {
+    if (!parseObjLine(linebuf.c_str(), linebuf.c_str() + linebuf.size(), parser, err)) {
+      return err;
     }
+  }
+  parser.finish();
 
-    // Skip leading space.
-    const char* token = linebuf.c_str();
-    token += strspn(token, " \t");
-
-    assert(token);
-    if (token[0] == '\0') continue; // empty line
-    
-    if (token[0] == '#') continue;  // comment line
-
-    // vertex
-    if (token[0] == 'v' && isSpace((token[1]))) {
-      token += 2;
-      float x, y, z;
-      parseFloat3(x, y, z, token);
-      v.push_back(x);
-      v.push_back(y);
-      v.push_back(z);
-      continue;
-    }
+  return err;
+}
 
-    // normal
-    if (token[0] == 'v' && token[1] == 'n' && isSpace((token[2]))) {
-      token += 3;
-      float x, y, z;
-      parseFloat3(x, y, z, token);
-      vn.push_back(x);
-      vn.push_back(y);
-      vn.push_back(z);
-      continue;
-    }
+std::string LoadObjMapped(
+  std::vector<shape_t>& shapes,
+  std::vector<material_t>& materials,   // [output]
+  const char* filename,
+  const char* mtl_basepath)
+{
+  shapes.clear();
 
-    // texcoord
-    if (token[0] == 'v' && token[1] == 't' && isSpace((token[2]))) {
-      token += 3;
-      float x, y;
-      parseFloat2(x, y, token);
-      vt.push_back(x);
-      vt.push_back(y);
-      continue;
-    }
+  MappedFile file(filename);
+  if (!file.data()) {
+    std::stringstream err;
+    err << "Cannot open file [" << filename << "]" << std::endl;
+    return err.str();
+  }
 
-    // face
-    if (token[0] == 'f' && isSpace((token[1]))) {
-      token += 2;
-      token += strspn(token, " \t");
+  std::string basePath;
+  if (mtl_basepath) {
+    basePath = mtl_basepath;
+  }
+  MaterialFileReader matFileReader( basePath );
 
-      std::vector<vertex_index> face;
-      while (!isNewLine(token[0])) {
-        vertex_index vi = parseTriple(token, v.size() / 3, vn.size() / 3, vt.size() / 2);
-        face.push_back(vi);
-        int n = strspn(token, " \t\r");
-        token += n;
-      }
+  std::string err;
+  ShapeVectorBuilder builder(shapes);
+  ObjParser parser(builder, materials, matFileReader);
 
-      faceGroup.push_back(face);
-      
-      continue;
-    }
+  bool ret = forEachLine(file.data(), file.data() + file.size(), [&](const char* line, const char* end) {
+    return parseObjLine(line, end, parser, err);
+  });
+  if (!ret) {
+    return err;
+  }
+  parser.finish();
 
-    // use mtl
-    if ((0 == strncmp(token, "usemtl", 6)) && isSpace((token[6]))) {
+  return err;
+}
 
-      char namebuf[4096];
-      token += 7;
-      sscanf(token, "%s", namebuf);
+std::string LoadObjMapped(
+  ShapeBuilder& builder,
+  std::vector<material_t>& materials,   // [output]
+  const char* filename,
+  const char* mtl_basepath,
+  size_t resident_bytes)
+{
+  MappedFile file(filename);
+  if (!file.data()) {
+    std::stringstream err;
+    err << "Cannot open file [" << filename << "]" << std::endl;
+    return err.str();
+  }
 
-      bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt, faceGroup, material, name, false);
-      faceGroup.clear();
+  std::string basePath;
+  if (mtl_basepath) {
+    basePath = mtl_basepath;
+  }
+  MaterialFileReader matFileReader( basePath );
 
-      if (material_map.find(namebuf) != material_map.end()) {
-        material = material_map[namebuf];
-      } else {
-        // { error!! material not found }
-        material = -1;
+  std::string err;
+  ObjParser parser(builder, materials, matFileReader);
+
+  // Parsed text is dropped from memory, and progress reported, every
+  // 'window' bytes.
+  const size_t window = resident_bytes ? resident_bytes : (16 << 20);
+  const char* data = file.data();
+  const char* dataEnd = data + file.size();
+  size_t released = 0;
+  bool cancelled = !builder.progress(0, file.size());
+  bool ret = !cancelled && forEachLine(data, dataEnd, [&](const char* line, const char* end) {
+    // An unterminated last line is a copy, not part of the mapping.
+    size_t offset = end == dataEnd ? line - data : released;
+    if (offset >= released + window) {
+      if (resident_bytes) {
+        file.release(released, offset - released);
       }
-
-      continue;
-
-    }
-
-    // load mtl
-    if ((0 == strncmp(token, "mtllib", 6)) && isSpace((token[6]))) {
-      char namebuf[4096];
-      token += 7;
-      sscanf(token, "%s", namebuf);
-        
-      std::string err_mtl = readMatFn(namebuf, materials, material_map);
-      if (!err_mtl.empty()) {
-        faceGroup.clear();  // for safety
-        return err_mtl;
+      released = offset;
+      if (!builder.progress(offset, file.size())) {
+        cancelled = true;
+        return false;
       }
-      
-      continue;
     }
+    return parseObjLine(line, end, parser, err);
+  });
+  if (cancelled) {
+    return "Loading cancelled\n";
+  }
+  if (!ret) {
+    return err;
+  }
+  builder.progress(file.size(), file.size());
+  parser.finish();
 
-    // group name
-    if (token[0] == 'g' && isSpace((token[1]))) {
-
-      // flush previous face group.
-      bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt, faceGroup, material, name, true);
-      if (ret) {
-        shapes.push_back(shape);
-      }
-
-      shape = shape_t();
+  return err;
+}
 
-      //material = -1;
-      faceGroup.clear();
+std::string LoadObjParallel(
+  std::vector<shape_t>& shapes,
+  std::vector<material_t>& materials,   // [output]
+  const char* filename,
+  const char* mtl_basepath,
+  unsigned int num_threads)
+{
+  shapes.clear();
 
-      std::vector<std::string> names;
-      while (!isNewLine(token[0])) {
-        std::string str = parseString(token);
-        names.push_back(str);
-        token += strspn(token, " \t\r"); // skip tag
-      }
+  ShapeVectorBuilder builder(shapes);
+  return LoadObjParallel(builder, materials, filename, mtl_basepath, num_threads);
+}
 
-      assert(names.size() > 0);
+std::string LoadObjParallel(
+  ShapeBuilder& builder,
+  std::vector<material_t>& materials,   // [output]
+  const char* filename,
+  const char* mtl_basepath,
+  unsigned int num_threads,
+  std::vector<std::string>* mtl_filenames)
+{
+  MappedFile file(filename);
+  if (!file.data()) {
+    std::stringstream err;
+    err << "Cannot open file [" << filename << "]" << std::endl;
+    return err.str();
+  }
 
-      // names[0] must be 'g', so skipt 0th element.
-      if (names.size() > 1) {
-        name = names[1];
-      } else {
-        name = "";
-      }
+  std::string basePath;
+  if (mtl_basepath) {
+    basePath = mtl_basepath;
+  }
+  MaterialFileReader matFileReader( basePath );
 
-      continue;
+  unsigned int numThreads = num_threads ? num_threads : glimac::getThreadCount();
+
+  // A few chunks per thread for load balancing, but not so small that the
+  // per-chunk bookkeeping shows up.
+  const size_t minChunkSize = 1 << 20;
+  size_t chunkCount = std::max<size_t>(1, std::min<size_t>(4 * numThreads, file.size() / minChunkSize));
+
+  const char* data = file.data();
+  const char* dataEnd = data + file.size();
+  std::vector<ObjChunk> chunks(chunkCount);
+  const char* chunkBegin = data;
+  for (size_t i = 0; i < chunkCount; ++i) {
+    const char* chunkEnd = dataEnd;
+    if (i + 1 < chunkCount) {
+      chunkEnd = std::max(chunkBegin, data + file.size() * (i + 1) / chunkCount);
+      const char* eol = static_cast<const char*>(memchr(chunkEnd, '\n', dataEnd - chunkEnd));
+      chunkEnd = eol ? eol + 1 : dataEnd;
     }
+    chunks[i].begin = chunkBegin;
+    chunks[i].end = chunkEnd;
+    chunkBegin = chunkEnd;
+  }
 
-    // object name
-    if (token[0] == 'o' && isSpace((token[1]))) {
-
-      // flush previous face group.
-      bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt, faceGroup, material, name, true);
-      if (ret) {
-        shapes.push_back(shape);
-      }
-
-      //material = -1;
-      faceGroup.clear();
-      shape = shape_t();
-
-      // @todo { multiple object name? }
-      char namebuf[4096];
-      token += 2;
-      sscanf(token, "%s", namebuf);
-      name = std::string(namebuf);
-
-
-      continue;
+  glimac::parallelFor(chunkCount, [&](size_t i) {
+    chunks[i].countAttributes();
+  }, numThreads);
+
+  // Exclusive prefix sums of the attribute counts give each chunk its base.
+  int vCount = 0, vnCount = 0, vtCount = 0;
+  size_t faceCount = 0;
+  for (size_t i = 0; i < chunkCount; ++i) {
+    int v = chunks[i].vBase, vn = chunks[i].vnBase, vt = chunks[i].vtBase;
+    chunks[i].vBase = vCount;
+    chunks[i].vnBase = vnCount;
+    chunks[i].vtBase = vtCount;
+    vCount += v;
+    vnCount += vn;
+    vtCount += vt;
+    faceCount += chunks[i].faceCount;
+  }
+  builder.reserve(vCount, vnCount, vtCount, faceCount);
+
+  std::string err;
+  ObjParser parser(builder, materials, matFileReader);
+  parser.v.resize(3 * vCount);
+  parser.vn.resize(3 * vnCount);
+  parser.vt.resize(2 * vtCount);
+
+  std::mutex progressMutex;
+  size_t parsedBytes = 0;
+  std::atomic<bool> cancelled(!builder.progress(0, file.size()));
+  glimac::parallelFor(chunkCount, [&](size_t i) {
+    if (cancelled) {
+      return;
     }
+    chunks[i].setPools(parser.v.data(), parser.vn.data(), parser.vt.data());
+    chunks[i].parse();
 
-    // Ignore unknown command.
+    std::lock_guard<std::mutex> lock(progressMutex);
+    parsedBytes += chunks[i].end - chunks[i].begin;
+    if (!builder.progress(parsedBytes, file.size())) {
+      cancelled = true;
+    }
+  }, numThreads);
+  if (cancelled) {
+    return "Loading cancelled\n";
   }
 
-  bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt, faceGroup, material, name, true);
-  if (ret) {
-    shapes.push_back(shape);
+  for (size_t i = 0; i < chunkCount; ++i) {
+    if (!chunks[i].replay(parser, file.size(), err)) {
+      return err;
+    }
+    chunks[i] = ObjChunk();  // release the records as soon as they are consumed
+  }
+  parser.finish();
+  if (mtl_filenames) {
+    *mtl_filenames = matFileReader.filenames();
   }
-  faceGroup.clear();  // for safety
 
-  return err.str();
+  return err;
 }
 
 
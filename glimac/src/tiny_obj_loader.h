@@ -9,6 +9,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
 
 namespace tinyobj {
 
@@ -49,6 +50,179 @@ typedef struct
     mesh_t       mesh;
 } shape_t;
 
+/// Read-only view of a whole file, memory-mapped when the platform allows it.
+/// data() is NULL if the file could not be opened.
+class MappedFile
+{
+public:
+    explicit MappedFile(const char* filename);
+    ~MappedFile();
+
+    const char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+
+    /// Drops the pages of [offset, offset + size) from memory. They are read
+    /// from the file again if accessed later.
+    void release(size_t offset, size_t size);
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const char* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    std::vector<char> m_buffer;
+#else
+    void* m_mapping;
+#endif
+};
+
+struct vertex_index {
+  int v_idx, vt_idx, vn_idx;
+  vertex_index() {};
+  vertex_index(int idx) : v_idx(idx), vt_idx(idx), vn_idx(idx) {};
+  vertex_index(int vidx, int vtidx, int vnidx) : v_idx(vidx), vt_idx(vtidx), vn_idx(vnidx) {};
+
+};
+inline bool operator==(const vertex_index& a, const vertex_index& b)
+{
+  return a.v_idx == b.v_idx && a.vn_idx == b.vn_idx && a.vt_idx == b.vt_idx;
+}
+
+// Open-addressing (linear probing) map from vertex_index to output vertex
+// index. Slots are tagged with a generation so clear() is O(1) and the
+// storage is reused across face groups and shapes.
+class VertexCache
+{
+public:
+  VertexCache(): m_size(0), m_generation(1) {}
+
+  // Returns the index cached for 'key', or caches and returns 'index'.
+  unsigned int findOrInsert(const vertex_index& key, unsigned int index)
+  {
+    if (2 * (m_size + 1) > m_slots.size()) {
+      grow();
+    }
+    size_t mask = m_slots.size() - 1;
+    for (size_t s = hash(key) & mask;; s = (s + 1) & mask) {
+      Slot& slot = m_slots[s];
+      if (slot.generation != m_generation) {
+        slot.key = key;
+        slot.index = index;
+        slot.generation = m_generation;
+        ++m_size;
+        return index;
+      }
+      if (slot.key == key) {
+        return slot.index;
+      }
+    }
+  }
+
+  // Bytes of one slot of the table, which keeps at least 2 slots per entry.
+  static size_t slotBytes() { return sizeof(Slot); }
+
+  // Makes room for 'count' entries without rehashing.
+  void reserve(size_t count)
+  {
+    while (2 * count > m_slots.size()) {
+      grow();
+    }
+  }
+
+  void clear()
+  {
+    m_size = 0;
+    if (++m_generation == 0) {
+      // Wrapped around: stale slots could alias the new generation.
+      for (size_t s = 0; s < m_slots.size(); ++s) {
+        m_slots[s].generation = 0;
+      }
+      m_generation = 1;
+    }
+  }
+
+private:
+  struct Slot {
+    vertex_index key;
+    unsigned int index;
+    unsigned int generation;
+  };
+
+  // Faces mostly reference nearby vertices, so runs of 8 consecutive
+  // positions share a block of slots: lookups stay in a few cache lines
+  // even when the table is much larger than the cache. Blocks themselves
+  // are scattered to keep probe sequences short.
+  static size_t hash(const vertex_index& key)
+  {
+    unsigned int h = (unsigned int)key.v_idx >> 3;
+    h *= 0x9E3779B1u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    unsigned int lane = key.v_idx ^ (key.vt_idx * 3) ^ (key.vn_idx * 5);
+    return (size_t(h) << 3) | (lane & 7);
+  }
+
+  void grow()
+  {
+    std::vector<Slot> slots(std::max<size_t>(1024, 2 * m_slots.size()));
+    for (size_t s = 0; s < slots.size(); ++s) {
+      slots[s].generation = 0;
+    }
+    slots.swap(m_slots);
+
+    unsigned int generation = m_generation;
+    m_size = 0;
+    m_generation = 1;
+    for (size_t s = 0; s < slots.size(); ++s) {
+      if (slots[s].generation == generation) {
+        findOrInsert(slots[s].key, slots[s].index);
+      }
+    }
+  }
+
+  std::vector<Slot> m_slots;
+  size_t m_size;
+  unsigned int m_generation;
+};
+
+/// Receives the faces of an OBJ file instead of shape_t, for callers that
+/// build their own mesh representation. Faces are handed over in groups,
+/// flushed on usemtl, g, o and at the end of the file.
+class ShapeBuilder
+{
+public:
+    virtual ~ShapeBuilder() {}
+
+    /// Size hint given before the first face group, when the loader knows it:
+    /// number of v, vn, vt and f records in the file.
+    virtual void reserve(size_t vertexCount, size_t normalCount, size_t texcoordCount, size_t faceCount) {
+        (void)vertexCount; (void)normalCount; (void)texcoordCount; (void)faceCount;
+    }
+
+    /// 'faceCount' polygons sharing 'material_id', polygon i has faceSizes[i]
+    /// corners, stored one after the other in 'indices' (zero-based, -1 for a
+    /// missing texcoord or normal). 'v', 'vn' and 'vt' are the attribute pools
+    /// of the file parsed so far.
+    virtual void faceGroup(
+        const std::string& name, int material_id,
+        const vertex_index* indices, const unsigned int* faceSizes, size_t faceCount,
+        const std::vector<float>& v, const std::vector<float>& vn, const std::vector<float>& vt) = 0;
+
+    /// The following face groups belong to a new shape (g, o, end of file).
+    virtual void endShape() = 0;
+
+    /// Called as the file gets parsed, by LoadObjParallel possibly from
+    /// worker threads but never concurrently. Returning false cancels the
+    /// load.
+    virtual bool progress(size_t bytesParsed, size_t totalBytes) {
+        (void)bytesParsed; (void)totalBytes;
+        return true;
+    }
+};
+
 class MaterialReader
 {
 public:
@@ -72,8 +246,12 @@ class MaterialFileReader:
           std::vector<material_t>& materials,
           std::map<std::string, int>& matMap);
 
+        /// Paths of the .mtl files read so far, in order
+        const std::vector<std::string>& filenames() const { return m_filenames; }
+
     private:
         std::string m_mtlBasePath;
+        std::vector<std::string> m_filenames;
 };
 
 /// Loads .obj from a file.
@@ -87,6 +265,47 @@ std::string LoadObj(
     const char* filename,
     const char* mtl_basepath = NULL);
 
+/// Loads .obj from a file by memory-mapping it and tokenizing the mapped
+/// bytes in place, without copying each line. Lines of any length are
+/// supported. Same output and error convention as LoadObj.
+std::string LoadObjMapped(
+    std::vector<shape_t>& shapes,   // [output]
+    std::vector<material_t>& materials,   // [output]
+    const char* filename,
+    const char* mtl_basepath = NULL);
+
+/// Same as above, faces are handed to 'builder' instead of building shapes.
+/// If 'resident_bytes' is not zero, the text already parsed is dropped from
+/// memory every 'resident_bytes' bytes, so that only the attribute pools
+/// grow with the file. Reports progress and can be cancelled.
+std::string LoadObjMapped(
+    ShapeBuilder& builder,
+    std::vector<material_t>& materials,   // [output]
+    const char* filename,
+    const char* mtl_basepath = NULL,
+    size_t resident_bytes = 0);
+
+/// Multi-threaded variant of LoadObjMapped. The file is split into
+/// line-aligned chunks that are parsed concurrently, then merged in file
+/// order, so the output is identical to LoadObj (see bench_selfcheck).
+/// 'num_threads' == 0 uses all hardware threads.
+std::string LoadObjParallel(
+    std::vector<shape_t>& shapes,   // [output]
+    std::vector<material_t>& materials,   // [output]
+    const char* filename,
+    const char* mtl_basepath = NULL,
+    unsigned int num_threads = 0);
+
+/// Same as above, faces are handed to 'builder' instead of building shapes.
+/// 'mtl_filenames', if not NULL, receives the paths of the .mtl files read.
+std::string LoadObjParallel(
+    ShapeBuilder& builder,
+    std::vector<material_t>& materials,   // [output]
+    const char* filename,
+    const char* mtl_basepath = NULL,
+    unsigned int num_threads = 0,
+    std::vector<std::string>* mtl_filenames = NULL);   // [output]
+
 /// Loads object from a std::istream, uses GetMtlIStreamFn to retrieve
 /// std::istream for materials.
 /// Returns empty string when loading .obj success.
@@ -96,6 +315,22 @@ std::string LoadObj(
     std::istream& inStream,
     MaterialReader& readMatFn);
 
+/// Same as above, faces are handed to 'builder' instead of building shapes.
+std::string LoadObj(
+    ShapeBuilder& builder,
+    std::vector<material_t>& materials,   // [output]
+    std::istream& inStream,
+    MaterialReader& readMatFn);
+
+/// Scans a decimal floating point number in [first, last) without looking
+/// at the locale, correctly rounded to float. Does not skip leading spaces.
+/// Returns a pointer past the number, or 'first' if there is none.
+const char* ScanFloat(const char* first, const char* last, float& value);
+
+/// Scans a decimal integer in [first, last), saturating on overflow.
+/// Returns a pointer past the number, or 'first' if there is none.
+const char* ScanInt(const char* first, const char* last, int& value);
+
 /// Loads materials into std::map
 /// Returns an empty string if successful
 std::string LoadMtl (